@@ -0,0 +1,277 @@
+import re
+import sys
+import json
+import math
+import functools
+
+"""
+Pick preemption thresholds and stack clusters for the kernel's fixed
+priority scheduler (KERNEL_SCHED = SCHED_RMS).
+Pass arguments: python3 preempt_threshold.py tasks.json [program.stack]
+            or: python3 preempt_threshold.py --benchmark
+
+tasks.json is a list of tasks in task_table order:
+  [{"name": "blink", "job": "blink", "period": 250, "deadline": 250, "wcet": 4800, "stack": 96}, ...]
+period and deadline are in kernel ticks (deadline defaults to period),
+wcet is in CPU cycles. stack is in bytes. stack and wcet are optional
+if program.stack (the log written by stack_analyze.py) has the job
+function in it, with a bounded WCET. The CPU and tick rates come from
+program.stack.json next to it, or are the config.h defaults without it.
+
+Priorities are deadline monotonic. Each task's threshold is raised as
+far as it goes while the set stays schedulable under response time
+analysis for preemption thresholds (Wang & Saksena), then tasks that
+can never preempt each other are packed into clusters that share one
+stack. The schedule is also simulated over a hyperperiod to count
+context switches with and without thresholds.
+
+Priorities and thresholds follow the kernel: lower value = higher
+priority, and a task can preempt a started job only if its priority is
+strictly above that job's threshold.
+"""
+
+# KERNEL_CPU_HZ and KERNEL_TICK_HZ. Read from program.stack.json when
+# there's a program.stack, otherwise the config.h defaults
+CPU_HZ = 48000000
+TICK_HZ = 1000
+
+# Per-task stack on top of the job itself: the context switch frame
+# (hardware exception frame + r4-r11) and _task_entry's own frame.
+TASK_FRAME = 64 + 16
+
+BENCHMARK = [
+  { "name": "sample",  "period": 5,   "wcet": 28800,  "stack": 96 },
+  { "name": "filter",  "period": 10,  "wcet": 72000,  "stack": 256 },
+  { "name": "control", "period": 20,  "wcet": 144000, "stack": 192 },
+  { "name": "comms",   "period": 40,  "wcet": 288000, "stack": 320 },
+  { "name": "log",     "period": 100, "wcet": 480000, "stack": 384 },
+  { "name": "ui",      "period": 200, "wcet": 960000, "stack": 256 },
+]
+
+
+class Task:
+  def __init__(self, index, d, cycles_per_tick):
+    self.index = index
+    self.name = d['name']
+    self.job = d.get('job', d['name'])
+    self.T = d['period'] * cycles_per_tick
+    self.D = d.get('deadline', d['period']) * cycles_per_tick
+    self.C = d.get('wcet')
+    self.stack = d.get('stack')
+    self.prio = 0
+    self.thr = 0
+
+
+"""
+Stack figures from the stack_analyze.py log. Its results section has one
+line per function:
+  blink[0x1234]:  24  blink(8) -> ...
+"""
+def load_stack_log(path):
+  with open(path) as f:
+    return { m[0]: int(m[1]) for m in re.findall(r'(?m)^(\w+)\[0x[0-9a-f]+\]:\s+(\d+)\s', f.read()) }
+
+
+"""
+WCET figures from the same log, in its WCET section:
+  WCET blink[0x1234]:  212 cycles (4.4 us)
+"""
+def load_wcet_log(path):
+  with open(path) as f:
+    return { m[0]: int(m[1]) for m in re.findall(r'(?m)^WCET (\w+)\[0x[0-9a-f]+\]:\s+(\d+) cycles', f.read()) }
+
+
+"""
+The kernel's clock, from the JSON report stack_analyze.py writes next to
+the log: (cpu_hz, tick_hz), or None if it has none.
+"""
+def load_clock(path):
+  with open(path + '.json') as f:
+    report = json.load(f)
+  return (report['cpu_hz'], report['tick_hz']) if report.get('cpu_hz') else None
+
+
+"""
+Worst case response time of task i with preemption thresholds, or None
+if it misses its deadline. Works in CPU cycles.
+"""
+def response_time(tasks, i):
+  hp = [t for t in tasks if t.prio < i.prio]               # Can preempt i before it starts
+  hp_thr = [t for t in tasks if t.prio < i.thr]            # Can preempt i after it starts
+  lp = [t for t in tasks if t.prio > i.prio and t.thr <= i.prio] # Can block i
+  blocking = max((t.C for t in lp), default=0)
+  limit = 1000 * max(t.T for t in tasks)
+
+  # Level-i busy period
+  busy = blocking + sum(t.C for t in tasks if t.prio <= i.prio)
+  while True:
+    nxt = blocking + sum(math.ceil(busy / t.T) * t.C for t in tasks if t.prio <= i.prio)
+    if nxt == busy: break
+    if nxt > limit: return None
+    busy = nxt
+
+  worst = 0
+  for q in range(math.ceil(busy / i.T)):
+    start = blocking + q * i.C + sum(t.C for t in hp)
+    while True:
+      nxt = blocking + q * i.C + sum((1 + start // t.T) * t.C for t in hp)
+      if nxt == start: break
+      if nxt > limit: return None
+      start = nxt
+
+    finish = start + i.C
+    while True:
+      nxt = start + i.C + sum((math.ceil(finish / t.T) - (1 + start // t.T)) * t.C for t in hp_thr)
+      if nxt == finish: break
+      if nxt > limit: return None
+      finish = nxt
+
+    worst = max(worst, finish - q * i.T)
+    if worst > i.D: return None
+
+  return worst
+
+
+def schedulable(tasks):
+  return sum(t.C / t.T for t in tasks) <= 1 and all(response_time(tasks, t) != None for t in tasks)
+
+
+"""
+Raise each task's threshold one level at a time, highest priority task
+first, for as long as the whole set stays schedulable.
+"""
+def assign_thresholds(tasks):
+  for t in sorted(tasks, key=lambda t: t.prio):
+    t.thr = t.prio
+    while t.thr > 0:
+      t.thr -= 1
+      if not schedulable(tasks):
+        t.thr += 1
+        break
+
+
+"""
+Greedily pack tasks that can't preempt each other into clusters. Each
+task joins the cluster whose stack grows the least, or starts a new one.
+"""
+def assign_clusters(tasks):
+  clusters = []
+  for t in sorted(tasks, key=lambda t: t.prio):
+    fits = [c for c in clusters if all(t.prio >= m.thr and m.prio >= t.thr for m in c)]
+    if fits:
+      best = min(fits, key=lambda c: max(0, t.stack - max(m.stack for m in c)))
+      best.append(t)
+    else:
+      clusters.append([t])
+  return clusters
+
+
+"""
+Simulate the schedule over one hyperperiod with every job running for
+its WCET. Counts switches between tasks (idle included, same as
+kernel_switches()) and preemptions of started jobs.
+"""
+def simulate(tasks, thresholds):
+  hyper = functools.reduce(math.lcm, (t.T for t in tasks))
+  next_release = { t: 0 for t in tasks }
+  remaining = { t: 0 for t in tasks }
+  started = { t: False for t in tasks }
+  running = None
+  switches = 0
+  preemptions = 0
+  now = 0
+
+  def key(t):
+    return t.thr if thresholds and started[t] else t.prio
+
+  while now < hyper:
+    for t in tasks:
+      if next_release[t] == now:
+        remaining[t] = t.C
+        started[t] = False
+        next_release[t] += t.T
+
+    ready = [t for t in tasks if remaining[t] > 0]
+    # On a tie the started job keeps the CPU, same as the kernel
+    nxt = min(ready, key=lambda t: (key(t), not started[t], t.index)) if ready else None
+    if nxt != running:
+      switches += 1
+      if running != None and remaining[running] > 0:
+        preemptions += 1
+      running = nxt
+
+    until = min(next_release.values())
+    if running == None:
+      now = until
+      continue
+    started[running] = True
+    step = min(until - now, remaining[running])
+    remaining[running] -= step
+    now += step
+
+  return switches, preemptions
+
+
+def main():
+  clock = None
+  if len(sys.argv) > 1 and sys.argv[1] == '--benchmark':
+    raw = BENCHMARK
+    stacks = {}
+    wcets = {}
+  else:
+    with open(sys.argv[1]) as f:
+      raw = json.load(f)
+    stacks = load_stack_log(sys.argv[2]) if len(sys.argv) > 2 else {}
+    wcets = load_wcet_log(sys.argv[2]) if len(sys.argv) > 2 else {}
+    clock = load_clock(sys.argv[2]) if len(sys.argv) > 2 else None
+  (cpu_hz, tick_hz) = clock or (CPU_HZ, TICK_HZ)
+  print(f'CPU {cpu_hz} Hz, tick {tick_hz} Hz ({"from " + sys.argv[2] + ".json" if clock else "config.h defaults"})\n')
+
+  tasks = [Task(i, d, cpu_hz // tick_hz) for i, d in enumerate(raw)]
+  for t in tasks:
+    if t.stack == None:
+      if t.job not in stacks:
+        print(f'** Error: No stack figure for {t.name} ({t.job} not in stack log) **')
+        exit(1)
+      t.stack = stacks[t.job] + TASK_FRAME
+    if t.C == None:
+      if t.job not in wcets:
+        print(f'** Error: No WCET for {t.name} ({t.job} not in stack log, or unbounded) **')
+        exit(1)
+      t.C = wcets[t.job]
+
+  # Deadline monotonic, ties broken by table order
+  for p, t in enumerate(sorted(tasks, key=lambda t: (t.D, t.index))):
+    t.prio = t.thr = p
+
+  if not schedulable(tasks):
+    print('** Error: Task set is not schedulable even fully preemptive **')
+    exit(1)
+
+  before = simulate(tasks, False)
+  assign_thresholds(tasks)
+  after = simulate(tasks, True)
+  clusters = assign_clusters(tasks)
+
+  stack_before = sum(t.stack for t in tasks)
+  stack_after = sum(max(m.stack for m in c) for c in clusters)
+  cluster_of = { t: n for n, c in enumerate(clusters) for t in c }
+
+  print(f'{"task":<12}{"prio":>6}{"thr":>6}{"resp(us)":>10}{"stack":>8}  cluster')
+  for t in tasks:
+    print(f'{t.name:<12}{t.prio + 1:>6}{t.thr + 1:>6}{response_time(tasks, t) * 1000000 // cpu_hz:>10}{t.stack:>8}  {cluster_of[t]}')
+
+  print()
+  print(f'Stack:             {stack_before} -> {stack_after} bytes ({len(tasks)} stacks -> {len(clusters)})')
+  print(f'Context switches:  {before[0]} -> {after[0]} per hyperperiod')
+  print(f'Preemptions:       {before[1]} -> {after[1]} per hyperperiod')
+
+  print('\n// task_table fields, generated by scripts/preempt_threshold.py')
+  for n, c in enumerate(clusters):
+    size = (max(m.stack for m in c) + 7) // 8 * 8
+    print(f'TASK_STACK(cluster{n}_stack, {size}); // {", ".join(m.name for m in c)}')
+  for t in tasks:
+    print(f'// {t.name}: .priority = {t.prio + 1}, .threshold = {t.thr + 1}, .stack = cluster{cluster_of[t]}_stack, .stack_size = sizeof(cluster{cluster_of[t]}_stack)')
+
+
+main()
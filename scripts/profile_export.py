@@ -0,0 +1,114 @@
+import re
+import sys
+import struct
+import subprocess
+
+"""
+Map a PC sampling profile dump (src/kernel/profile.h) to functions and tasks.
+Pass arguments: python3 profile_export.py program.elf profile.bin [profile.txt]
+
+Dump profile.bin from GDB with the firmware built with KERNEL_PROFILE=1:
+  (gdb) dump binary value profile.bin kernel_profile
+
+Functions come from the symbol table, with nm the same way stack_analyze.py
+and trace_export.py do. A histogram bucket that spans more than one function
+is split between them by how many of its bytes each one has. Tasks are named
+after their job (or coroutine) function, same as the trace.
+
+profile.txt gets the samples per function as "# samples <seconds>" and then
+"name count" lines, for scripts/ramfunc.py (make ramfunc PROFILE=profile.txt).
+"""
+
+nm = 'arm-none-eabi-nm'
+
+RAM_START = 0x20000000
+
+
+"""
+nm gives the symbol table, start addr, size, type and name:
+00001c18 00000060 T TC2_Handler
+"""
+def load_symbols(elf_file):
+  out = subprocess.check_output([nm, '-n', '--print-size', elf_file], encoding='ascii')
+  functions = []
+  objects = {}
+  for m in re.findall(r'(?m)^([0-9a-f]+) ([0-9a-f]+) (.) (.*)$', out):
+    addr, size, kind, name = int(m[0], 16), int(m[1], 16), m[2], m[3]
+    if kind in 'tTwW' and size > 0:
+      functions.append((addr & ~1, (addr & ~1) + size, name))
+    objects[name] = (addr, size)
+  return functions, objects
+
+
+def main():
+  elf_file, profile_file = sys.argv[1], sys.argv[2]
+  functions, objects = load_symbols(elf_file)
+
+  if 'kernel_profile' not in objects:
+    print('** Error: No kernel_profile in the ELF, was it built with KERNEL_PROFILE=1? **')
+    exit(1)
+
+  with open(profile_file, 'rb') as f:
+    raw = f.read()
+
+  # Profile_t
+  (samples, hz, bucket, flash_buckets, ram_buckets, tasks_num, other) = struct.unpack_from('<IHHHHHH', raw, 0)
+  offset = 16
+  tasks = struct.unpack_from(f'<{tasks_num + 2}I', raw, offset)
+  offset += 4 * (tasks_num + 2)
+  jobs = struct.unpack_from(f'<{tasks_num}H', raw, offset)
+  offset += 2 * tasks_num
+  pcs = struct.unpack_from(f'<{flash_buckets + ram_buckets}H', raw, offset)
+
+  if samples == 0:
+    print('** Error: No samples, was the profile dumped before the kernel started? **')
+    exit(1)
+  seconds = samples / hz
+
+  def bucket_range(k):
+    start = k * bucket if k < flash_buckets else RAM_START + (k - flash_buckets) * bucket
+    return start, start + bucket
+
+  # Share each bucket out between the functions in it, by bytes
+  counts = {}
+  for k, count in enumerate(pcs):
+    if count == 0: continue
+    lo, hi = bucket_range(k)
+    overlaps = [(min(end, hi) - max(start, lo), name) for (start, end, name) in functions if start < hi and end > lo]
+    covered = sum(n for (n, _) in overlaps)
+    for (n, name) in overlaps:
+      counts[name] = counts.get(name, 0) + count * n / bucket
+    if covered < bucket:
+      counts['(no function)'] = counts.get('(no function)', 0) + count * (bucket - covered) / bucket
+  if other:
+    counts['(outside the histogram)'] = other
+
+  by_addr = { start: name for (start, end, name) in functions }
+  def task_name(i):
+    if i == tasks_num: return 'idle'
+    if i == tasks_num + 1: return 'interrupts'
+    return by_addr.get(jobs[i] & 0xFFFE, f'task{i}')
+
+  print(f'-- {samples} samples at {hz} Hz ({seconds:.1f} s), {bucket} byte buckets --')
+  if any(c == 0xFFFF for c in pcs) or other == 0xFFFF:
+    print('** Warning: Some buckets saturated at 65535, dump sooner for exact shares **')
+
+  print('  Tasks:')
+  for i, count in enumerate(tasks):
+    if count:
+      print(f'    {task_name(i):<24} {count:8d} {count / samples:7.2%}')
+
+  print('  Functions:')
+  for name, count in sorted(counts.items(), key=lambda c: -c[1]):
+    if count >= 0.5:
+      print(f'    {name:<24} {count:8.0f} {count / samples:7.2%}')
+
+  if len(sys.argv) > 3:
+    with open(sys.argv[3], 'w') as f:
+      print(f'# samples {seconds:.1f}', file=f)
+      for name, count in sorted(counts.items(), key=lambda c: -c[1]):
+        if count >= 0.5 and not name.startswith('('):
+          print(f'{name} {round(count)}', file=f)
+
+
+main()
@@ -0,0 +1,132 @@
+import os
+import re
+import sys
+import json
+
+"""
+Pick the hottest functions to run from RAM, out of the flash wait states.
+Pass arguments: python3 ramfunc.py program.elf profile.txt [budget]
+
+Flash runs with two wait states at 48 MHz (see _conf_clocks()), code in
+SRAM runs with none. Moving a function costs its size in SRAM for good
+(it's copied there by Reset_Handler, in .relocate), so only the ones that
+pay for it go, greedily by cycles saved per byte until budget bytes of
+RAM (default 512) are used up.
+
+profile.txt is the first line, what was counted and over how long, then a
+function name and a count per line:
+  # calls 600.0         (calls per function, from make sim)
+  # samples 10.0        (PC samples per function, from a PC sampling profile)
+  kernel_tick 600000
+  ...
+Sizes and cycle counts come from program.stack.json, written next to the
+ELF by stack_analyze.py (make stack-analyze).
+
+With call counts, each call saves wcet_flash - wcet_ram, the function's
+own wait states on its worst path. With PC samples, the function's share
+of the samples is its share of CPU time, of which wait_share goes on wait
+states. Either way calls between flash and RAM go through a linker veneer,
+which is taken off: one per call in, and one per call out to a function
+left in flash, each callee assumed to be called once. Sampled profiles
+don't count calls, so they're estimated at one per worst case run, which
+is the fewest there could be.
+
+The picks go in ramfuncs.ld next to the ELF, which the linker script
+includes at the top of .relocate. make ramfunc runs this and relinks.
+Functions already in RAM that aren't in ramfuncs.ld (__attribute__
+section(".ramfunc")) are left alone and don't count against the budget.
+"""
+
+# Cycles through a veneer from flash: push, ldr, mov, pop, bx plus the fetches
+# and the literal at two wait states (see the veneers in stack_analyze.py)
+VENEER_CYCLES = 18
+
+RAM_START = 0x20000000
+
+# Run before .relocate is copied, or not worth it
+EXCLUDE = ['Reset_Handler']
+
+ALIGN = 4
+
+
+def main():
+  elf_file, profile_file = sys.argv[1], sys.argv[2]
+  budget = int(sys.argv[3]) if len(sys.argv) > 3 else 512
+  ld_file = os.path.join(os.path.dirname(elf_file), 'ramfuncs.ld')
+
+  with open(elf_file.replace('.elf', '.stack.json')) as f:
+    report = json.load(f)
+  functions = report['functions']
+  cpu_hz = report.get('cpu_hz') # KERNEL_CPU_HZ
+  if not cpu_hz:
+    print(f'** Error: No CPU clock in {elf_file.replace(".elf", ".stack.json")}, run make stack-analyze on the kernel build **')
+    exit(1)
+
+  with open(profile_file) as f:
+    header = f.readline().split()
+    counts = {}
+    for line in f:
+      parts = line.split()
+      if len(parts) >= 2 and not parts[0].startswith('#'):
+        counts[parts[0]] = counts.get(parts[0], 0) + int(parts[1])
+  if len(header) < 3 or header[0] != '#' or header[1] not in ('calls', 'samples'):
+    print(f'** Error: {profile_file} should start with "# calls <seconds>" or "# samples <seconds>" **')
+    exit(1)
+  kind, seconds = header[1], float(header[2])
+  total_samples = sum(counts.values())
+
+  # Picked last time, so in RAM now but not for good
+  picked = set()
+  if os.path.exists(ld_file):
+    with open(ld_file) as f:
+      picked = set(re.findall(r'(?m)^\s*\*\(\.text\.(\S+) ', f.read()))
+
+  # name: (bytes, cycles saved per second)
+  candidates = {}
+  for name, count in counts.items():
+    fn = functions.get(name)
+    if fn == None or name in EXCLUDE or re.fullmatch(r'__.+_veneer', name):
+      continue
+    if fn['address'] >= RAM_START and name not in picked:
+      continue
+    callees_in_flash = [c for c in fn['calls'] if c in functions and functions[c]['address'] < RAM_START and c not in picked]
+    veneers = 1 + len(callees_in_flash)
+
+    if kind == 'calls':
+      if fn['wcet_flash'] == None: continue
+      rate = count / seconds
+      saved = rate * (fn['wcet_flash'] - fn['wcet_ram'] - veneers * VENEER_CYCLES)
+    else:
+      busy = count / total_samples * cpu_hz
+      saved = busy * fn['wait_share']
+      if fn['wcet_flash']:
+        saved -= busy / fn['wcet_flash'] * veneers * VENEER_CYCLES
+
+    if saved > 0:
+      candidates[name] = ((fn['size'] + ALIGN - 1) // ALIGN * ALIGN, saved)
+
+  chosen = []
+  used = 0
+  for name, (size, saved) in sorted(candidates.items(), key=lambda c: -c[1][1] / c[1][0]):
+    if used + size <= budget:
+      chosen.append((name, size, saved))
+      used += size
+
+  total = sum(saved for (_, _, saved) in chosen)
+  with open(ld_file, 'w') as f:
+    print(f'/* Generated by scripts/ramfunc.py from {os.path.basename(elf_file)} and {os.path.basename(profile_file)}, do not edit. */', file=f)
+    print(f'/* {len(chosen)} functions run from RAM, {used} / {budget} bytes, saves {total:.0f} cycles/s */', file=f)
+    for (name, size, saved) in chosen:
+      print(f'*(.text.{name} .text.*.{name}) /* {size} bytes, {saved:.0f} cycles/s */', file=f)
+
+  print(f'-- Functions to run from RAM, from {kind} over {seconds:g} s --')
+  width = max((len(name) for (name, _, _) in chosen), default=0) + 2
+  for (name, size, saved) in chosen:
+    print(f'  {name:<{width}} {size:5d} bytes {saved:10.0f} cycles/s {saved / cpu_hz:7.3%} CPU')
+  print(f'  RAM: {used} / {budget} bytes, saves {total:.0f} cycles/s ({total / cpu_hz:.3%} of the CPU), see {ld_file}')
+  skipped = [name for name in candidates if name not in (c[0] for c in chosen)]
+  if skipped:
+    print(f'  Over budget: {", ".join(skipped)}')
+
+
+main()
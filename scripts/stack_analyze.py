@@ -1,16 +1,28 @@
 import re
 import os
 import sys
+import json
+import struct
+import hashlib
 import subprocess
 import bisect
 import operator
 import array
+import math
+import shlex
 
 """
-Parse debugging information and assembly to determine stack usage of a program.
-Pass arguments: python3 stack_analyze.py program.elf program.stack
+Parse debugging information and assembly to determine stack usage of a program,
+and the worst case execution time of each function (see WCET analysis below).
+Pass arguments: python3 stack_analyze.py program.elf program.stack [--fit margin]
 
-Log output will be written to program.stack
+Log output will be written to program.stack, a JSON report to program.stack.json
+and a disassembly cache to program.stack-cache.json.
+
+With --fit, the main stack and task stacks are sized to what they need plus
+margin bytes, in stack_sizes.ld (STACK_SIZE, for the linker script) and
+stack_sizes.h (for TASK_STACK and KERNEL_IDLE_STACK_SIZE) next to the ELF.
+make stack-fit does this and rebuilds.
 
 This requires a little help from the linker.
 The linker must provide the following symbols:
@@ -22,6 +34,16 @@ _sstack, _estack = Start and end of stack region. This is subtracted from SRAM v
 exception_table = Symbol (with defined size) indicating the location and length of the exception table in memory.
   Must reside in either the start of .vectors (if exists) or .text otherwise.
 
+objdump is arm-none-eabi-objdump, or $OBJDUMP if set, split into words the
+way the shell would. llvm-objdump needs the CPU to decode ARMv6-M properly
+(mrs and msr, and the branches after them):
+  OBJDUMP="llvm-objdump --mcpu=cortex-m0plus" make stack-analyze
+
+Calls through function pointers need INDIRECT_CALL() (src/common/analysis.h) to
+be followed. With the kernel, every task in task_table also gets the stack it
+needs worked out, against what it has, and the times next to cycle counts
+are at KERNEL_CPU_HZ, from .kernel_clock.
+
 All functions must include sizes.
 Clang will do this by default for C programs, in ASM ensure you write .size after every function.
 See the asm examples.
@@ -29,12 +51,10 @@ See the asm examples.
 
 # Argument parsing
 
-objcopy = os.path.join('arm-none-eabi-objcopy')
-objdump = os.path.join('arm-none-eabi-objdump')
-nm = os.path.join('arm-none-eabi-nm')
-
-(_, elf_file, stack_file) = sys.argv
+objdump = shlex.split(os.environ.get('OBJDUMP', 'arm-none-eabi-objdump'))
 
+(_, elf_file, stack_file, *options) = sys.argv
+fit_margin = int(options[1]) if options[:1] == ['--fit'] else None
 
 
 RED = '\033[91m'
@@ -63,32 +83,54 @@ with open(stack_file, 'w+') as logfile:
   warning_stack = []
 
   """
-  nm gives the symbol table which contains the start addr, size, and name of each
-  symbol. Looking at `t`, or text symbols, the functions can be identified.
-  $d.* sections are data sections at the end of a function, so will be excluded
-  from the total length of the function.
-
-  0000111c 00000000 t $d.1
-  00001c18 00000060 t TC2_Handler
-  00001544 00000036 t __muldi3
+  Read the ELF directly, no nm or objcopy: the section headers, then the
+  symbol table, which contains the start addr, size, and name of each symbol.
+  Function symbols are the functions. $d.* symbols mark data at the end of a
+  function, so will be excluded from the total length of the function.
 
+  Thumb functions have bit 0 set in their symbol value. It's cleared here,
+  same as nm does, so they line up with the disassembly.
   """
-  nm_out_raw = subprocess.check_output([nm, "-n", "--print-size", "--special-syms", elf_file], encoding='ascii')
-
-  # GCC nm differs from llvm-nm here -- llvm outputs sizes for all symbols, including
-  # linker symbols (i.e. ROM_LENGTH) that don't have a real size in flash/ram.
-  # We need to add those back.
-  nm_out = ""
-  for line in nm_out_raw.splitlines():
-    if len(line.split()) < 4:
-      split = line.split()
-      split.insert(1, "00000000")
-      nm_out += " ".join(split) + "\n"
-    else:
-      nm_out += line + "\n"
+  SHT_SYMTAB = 2
+  SHT_NOBITS = 8
+  SHF_ALLOC = 0x2
+  STT_FUNC, STT_SECTION, STT_FILE = 2, 3, 4
+
+  with open(elf_file, 'rb') as f:
+    elf = f.read()
+  if elf[:6] != b'\x7fELF\x01\x01':
+    raise RuntimeError('Not a 32 bit little endian ELF', elf_file)
+
+  (shoff,) = struct.unpack_from('<I', elf, 0x20)
+  (shentsize, shnum, shstrndx) = struct.unpack_from('<HHH', elf, 0x2E)
+  # [(name, type, flags, addr, offset, size, link)]
+  headers = [struct.unpack_from('<IIIIIII', elf, shoff + i * shentsize) for i in range(shnum)]
+
+  def elf_string(table, offset):
+    start = headers[table][4] + offset
+    return elf[start:elf.index(b'\0', start)].decode('ascii', 'replace')
+
+  class Section:
+    def __init__(self, header):
+      (name, self.type, self.flags, self.addr, self.offset, self.size, self.link) = header
+      self.name = elf_string(shstrndx, name)
+      self.data = bytes(self.size) if self.type == SHT_NOBITS else elf[self.offset:self.offset + self.size]
+
+  sections = [Section(h) for h in headers]
+  section_map = { s.name: s for s in sections }
+
+  # [(start, end, name, is a function)]
+  symbols = []
+  for symtab in (s for s in sections if s.type == SHT_SYMTAB):
+    for k in range(1, symtab.size // 16):
+      (name, value, size, info, _, _) = struct.unpack_from('<IIIBBH', elf, symtab.offset + 16 * k)
+      if info & 0xF in (STT_SECTION, STT_FILE): continue
+      if info & 0xF == STT_FUNC: value &= ~1
+      symbols.append((value, value + size, elf_string(symtab.link, name), info & 0xF == STT_FUNC))
+  symbols.sort(key=lambda m: (m[0], m[2]))
 
   # [(start, end, name)]
-  nm_parsed = [(int(match[0], 16), int(match[0], 16) + int(match[1], 16), match[2]) for match in re.findall(r'(?m)^([0-9a-f]+) ([0-9a-f]+) . (.*)$', nm_out)]
+  nm_parsed = [m[:3] for m in symbols]
 
   # Shrink all functions to not include their extra static data section
   for (start, end, name) in nm_parsed:
@@ -105,6 +147,16 @@ with open(stack_file, 'w+') as logfile:
   name_start_end_map = { m[2]: (m[2], m[0], m[1]) for m in nm_parsed }
   debugprint('\n'.join(str(s) for s in start_end_name_map.values()))
 
+  # Calls between flash and RAM (.ramfunc, make ramfunc) are out of range of a
+  # bl, so the linker sends them through a veneer, __<name>_veneer:
+  #   push {r0}; ldr r0, [pc, #8]; mov ip, r0; pop {r0}; bx ip
+  # veneer start: start of the function it goes on to
+  veneers = {}
+  for (start, end, name) in start_end_name_map.values():
+    m = re.fullmatch(r'__(.+)_veneer', name)
+    if m and m[1] in name_start_end_map:
+      veneers[start] = name_start_end_map[m[1]][1]
+
 
   """
   Get the disassembly of the text (ro executable code in flash)
@@ -117,9 +169,66 @@ with open(stack_file, 'w+') as logfile:
   the stack usage of the function
   `    10c0: b5d0         	push	{r4, r6, r7, lr}`
   and the call tree of the program by finding `bl` instructions.
+
+  objdump is the slow part, so each function's disassembly is cached in
+  program.stack-cache.json, keyed by a hash of its address and bytes, and
+  thrown away if $OBJDUMP changes. Only
+  functions that changed since the last run are disassembled again. Code
+  moving changes the bytes (branch offsets, literal pools), so everything
+  after an edit usually goes, but a rebuild with no changes runs no objdump.
   """
+  CACHE_VERSION = 1
 
-  out = subprocess.check_output([objdump, "--disassemble", "--section=.text", "--section=.relocate", elf_file], encoding='ascii')
+  cache_file = elf_file.replace('.elf', '.stack-cache.json')
+  try:
+    with open(cache_file) as f:
+      cache = json.load(f)
+  except (OSError, ValueError):
+    cache = {}
+  cached = cache.get('functions', {}) if cache.get('version') == CACHE_VERSION and cache.get('objdump') == objdump else {}
+
+  code_sections = [s for s in sections if s.name in ('.text', '.relocate') and s.type != SHT_NOBITS]
+
+  # start: (end, hash) of every function in them
+  code = {}
+  for (start, end, name, is_function) in symbols:
+    for s in code_sections:
+      if is_function and s.addr <= start < end <= s.addr + s.size:
+        code[start] = (end, hashlib.sha1(start.to_bytes(4, 'little') + s.data[start - s.addr:end - s.addr]).hexdigest())
+  code_starts = sorted(code)
+
+  # Disassemble runs of stale functions with nothing cached in between in one go
+  fresh = [start for start in code_starts if code[start][1] in cached]
+  spans = []
+  for start in (start for start in code_starts if code[start][1] not in cached):
+    if spans and bisect.bisect_left(fresh, spans[-1][1]) == bisect.bisect_left(fresh, start):
+      spans[-1][1] = code[start][0]
+    else:
+      spans.append([start, code[start][0]])
+
+  for (start, end) in spans:
+    out = subprocess.check_output([*objdump, '--disassemble', f'--start-address=0x{start:x}', f'--stop-address=0x{end:x}', elf_file], encoding='ascii')
+    lines = {}
+    owner = None
+    for line in out.splitlines():
+      m = re.match(r' *([0-9a-f]+):', line)
+      if m:
+        k = bisect.bisect_right(code_starts, int(m[1], 16)) - 1
+        owner = code_starts[k] if k >= 0 and int(m[1], 16) < code[code_starts[k]][0] else None
+      elif not line.startswith('\t'): # Repeated instruction marker belongs to the line before
+        owner = None
+        continue
+      if owner != None:
+        lines.setdefault(owner, []).append(line)
+    for f in range(bisect.bisect_left(code_starts, start), bisect.bisect_left(code_starts, end)):
+      cached[code[code_starts[f]][1]] = '\n'.join(lines.get(code_starts[f], []))
+
+  debugprint(f'Disassembled {len(code) - len(fresh)} of {len(code)} functions in {len(spans)} runs')
+
+  with open(cache_file, 'w') as f:
+    json.dump({ 'version': CACHE_VERSION, 'objdump': objdump, 'functions': { key: cached[key] for (_, key) in code.values() } }, f)
+
+  out = '\n'.join(cached[code[start][1]] for start in code_starts) + '\n'
 
   debugprint(out)
 
@@ -156,11 +265,31 @@ with open(stack_file, 'w+') as logfile:
       return f'{hex(self.addr)} {self.addr} [{self.len}]-> {self.name} {self.arg0} {self.arg1} {self.arg2} {"*" if self.repeated else ""}'
 
   # See https://regex101.com/r/TZXzL7/1
-  instructions = [Instruction(m) for m in re.findall(r'(?m)^ *([0-9a-f]+):\s+([0-9a-f ]*[0-9a-f]+) +\t([^\t\n]+)(?:\t(\w+|.*)(?:, \[?#?(\w+)(?:, #?([^]\n]*))?)?.*(?:\n\t\t(...))?)?', out)]
+  instructions = [Instruction(m) for m in re.findall(r'(?m)^ *([0-9a-f]+):\s+([0-9a-f ]*[0-9a-f]+) *\t([^\t\n]+)(?:\t(\w+|.*)(?:, \[?#?(\w+)(?:, #?([^]\n]*))?)?.*(?:\n\t\t(...))?)?', out)]
 
   def find_instruction(addr: int):
     return bisect.bisect_left(instructions, addr, key=operator.attrgetter('addr'))
 
+  # Thumb branch targets straight from the encoding, whatever objdump prints
+  def branch_target(inst):
+    hw1 = inst.data & 0xFFFF
+    if inst.len == 2:
+      if hw1 & 0xF000 == 0xD000 and (hw1 >> 8) & 0xF < 0xE:
+        offset = (hw1 & 0xFF) - ((hw1 & 0x80) << 1)
+      elif hw1 & 0xF800 == 0xE000:
+        offset = (hw1 & 0x7FF) - ((hw1 & 0x400) << 1)
+      else:
+        return None
+      return inst.addr + 4 + 2 * offset
+    hw2 = inst.data >> 16
+    if hw1 & 0xF800 != 0xF000 or hw2 & 0xD000 != 0xD000:
+      return None
+    s = (hw1 >> 10) & 1
+    i1 = ~((hw2 >> 13) ^ s) & 1
+    i2 = ~((hw2 >> 11) ^ s) & 1
+    offset = (s << 24) | (i1 << 23) | (i2 << 22) | ((hw1 & 0x3FF) << 12) | ((hw2 & 0x7FF) << 1)
+    return inst.addr + 4 + offset - ((offset & (1 << 24)) << 1)
+
 
   """
   Align an iterable of iterables for pretty printing
@@ -195,11 +324,14 @@ with open(stack_file, 'w+') as logfile:
   class Function:
     WIP = 1
     NOTFOUND = 2
-    def __init__(self, start, stack, callees):
+    def __init__(self, start, stack, callees, fields):
       self.start = start
       self.end = start_end_name_map[start][1]
       self.name = start_end_name_map[start][2]
       self.stack = stack
+      self.direct_callees = callees
+      self.fields = fields # TaskConf_t offset: [targets], calls into the task table
+      callees = callees + [f for targets in fields.values() for f in targets]
       self.critical_path = max((functions[f] for f in callees), key=operator.attrgetter('total_stack')) if len(callees) > 0 else None
       self.total_stack = stack + (self.critical_path.total_stack if self.critical_path != None else 0)
       self.callees = callees
@@ -245,8 +377,9 @@ with open(stack_file, 'w+') as logfile:
 
   Function calls usually use `bl` instructions. Function pointers usually use
   a `blx` instruction (branch to register), figuring out where they're jumping to
-  requires simulating the register values. That's too hard, just stop the call tree
-  when we see it and move on.
+  requires simulating the register values. That's too hard, so take the targets
+  from the annotations above. Without one, just stop the call tree when we see it
+  and move on.
 
   Other branch types (`b`, `beq`, ...) aren't used for function calls, so ignore them.
 
@@ -269,6 +402,7 @@ with open(stack_file, 'w+') as logfile:
     # Total stack used so far and callees identified (start addresses)
     stack = 0
     callees = []
+    fields = {}
 
     # Find the address after the end of this function to iterate over
     (_, end_pc, name) = start_end_name_map[start]
@@ -327,7 +461,7 @@ with open(stack_file, 'w+') as logfile:
 
       # If it's a bl, mark the dependency and inveestigate it.
       elif inst.name == 'bl':
-        inst.arg0 = int(str(inst.arg0), 16) # Convert the branch address from hex string to integer
+        inst.arg0 = branch_target(inst)
         debugprint(functions, inst.arg0, inst.arg0 not in functions)
         if inst.arg0 in start_end_name_map:
           callees.append(inst.arg0)
@@ -340,12 +474,7 @@ with open(stack_file, 'w+') as logfile:
           if functions[inst.arg0] == Function.WIP:
             raise RuntimeError(f"Recursion detected between {name} and {start_end_name_map[inst.arg0][2]}. I'm not happy.", pc, inst.addr)
         else:
-          try:
-            inst_arg0_int = int(inst.arg0, base=16)
-          except TypeError:
-            inst_arg0_int = inst.arg0
-
-          is_local_bl = inst_arg0_int > start and inst_arg0_int <= end_pc
+          is_local_bl = inst.arg0 > start and inst.arg0 <= end_pc
           if not is_local_bl:
             debugprint(f'** Warning: Could not find target for bl to {inst.arg0}')
             warning_stack += [f'** Warning: Could not find target for bl to {inst.arg0} **']
@@ -353,6 +482,29 @@ with open(stack_file, 'w+') as logfile:
             debugprint(f'** Found local bl to {inst.arg0}')
 
 
+      # The jump out of a veneer, same as a bl to the function it's for
+      elif inst.name == 'bx' and start in veneers:
+        target = veneers[start]
+        callees.append(target)
+        if target not in functions:
+          parse_function(target)
+        if functions[target] == Function.WIP:
+          raise RuntimeError(f"Recursion detected between {name} and {start_end_name_map[target][2]}. I'm not happy.", pc, inst.addr)
+
+      # BLX with annotated targets, same as a bl to each of them
+      elif inst.name == 'blx' and inst.addr in blx_targets:
+        for target in blx_targets[inst.addr]:
+          if target not in start_end_name_map:
+            raise RuntimeError(f"Indirect call from {name} to 0x{target:08X}, which is not a function", pc, inst.addr)
+          if target not in functions:
+            parse_function(target)
+          if functions[target] == Function.WIP:
+            raise RuntimeError(f"Recursion detected between {name} and {start_end_name_map[target][2]}. I'm not happy.", pc, inst.addr)
+          if inst.addr in blx_fields:
+            fields.setdefault(blx_fields[inst.addr], []).append(target)
+          else:
+            callees.append(target)
+
       # BLX is an arbitrary-destination branch and link. Too hard to figure out.
       elif inst.name == 'blx':
         global blx_counter
@@ -374,7 +526,7 @@ with open(stack_file, 'w+') as logfile:
 
       i += 1
 
-    functions[start] = Function(start, stack, callees)
+    functions[start] = Function(start, stack, callees, fields)
     return functions[start]
 
 
@@ -386,10 +538,11 @@ with open(stack_file, 'w+') as logfile:
   the next 46 are handlers.
 
   Important handlers are Reset -> Start of code on boot.
-  Any other handler -> Can interrupt Reset
-  Hardfault -> Can interrupt any other handler.
+  Any other handler -> Can interrupt Reset, and handlers at a lower priority
+  Hardfault -> Can interrupt any other handler but NMI.
 
-  The total depth of Reset + max(others) + Hardfault is the max depth
+  The total depth of Reset + the largest handler at each priority is the max
+  depth, see interrupt nesting below.
 
     void* stack_ptr;
 
@@ -446,17 +599,12 @@ with open(stack_file, 'w+') as logfile:
   """
   UINT32 = next(code for code in array.typecodes if code.isupper() and array.array(code).itemsize == 4)
 
-  # GCC objcopy differs from llvm-objcopy here -- llvm-objcopy can dump the output
-  # to shell, GCC can't. Just make a temporary file and read it back.
-  bin_file = elf_file.replace(".elf", ".bin")
-  subprocess.check_output([objcopy, '-O', 'binary', '--only-section=.vectors', elf_file, bin_file])
-  out = bytes()
-  with open(bin_file, 'br') as bin:
-    out = bin.read()
-  os.remove(bin_file) # Clean up
-
-  if len(out) == 0:
-    out = subprocess.check_output([objcopy, '-O', 'binary', elf_file, '-'])
+  # The start of .vectors, or of the image (like objcopy -O binary) without one
+  loaded = sorted((s for s in sections if s.flags & SHF_ALLOC and s.type != SHT_NOBITS and s.size > 0), key=lambda s: s.addr)
+  if '.vectors' in section_map and section_map['.vectors'].size > 0:
+    out = section_map['.vectors'].data
+  else:
+    out = loaded[0].data if loaded else bytes()
   if len(out) > 47 * 4:
     out = out[:47*4]
 
@@ -471,10 +619,111 @@ with open(stack_file, 'w+') as logfile:
 
   debugprint('Exception Table: [' + ', '.join(f'0x{e:08X}' for e in exception_table) + ']')
 
+  """
+  Memory contents straight from the sections. Only sections that are loaded
+  count as memory. Annotations (src/common/analysis.h) and debug info live in
+  sections that aren't, those start at 0 too.
+  """
+  section_table = [(s.name, s.addr, s.addr + s.size) for s in loaded]
+
+  def dump_section(section):
+    return section_map[section].data if section in section_map else bytes()
+
+  # (address, word) pairs left by the annotations
+  def load_annotations(section):
+    raw = dump_section(section)
+    words = array.array(UINT32, raw[:len(raw) // 8 * 8])
+    return sorted((words[i] & ~1, words[i + 1]) for i in range(0, len(words), 2))
+
+  def read_memory(addr, size):
+    for (name, start, end) in section_table:
+      if start <= addr < end:
+        return dump_section(name)[addr - start:addr - start + size]
+    raise KeyError(addr)
+
+  def read_word(addr):
+    return array.array(UINT32, read_memory(addr, 4))[0]
+
+  # KERNEL_CPU_HZ and KERNEL_TICK_HZ from .kernel_clock (kernel.c), for the
+  # times next to cycle counts. Without the kernel they're left out.
+  kernel_clock = dump_section('.kernel_clock')
+  (cpu_hz, tick_hz) = array.array(UINT32, kernel_clock[:8]) if len(kernel_clock) >= 8 else (None, None)
+
+  def us(cycles):
+    return f'({cycles / cpu_hz * 1e6:.1f} us)' if cpu_hz else ''
+
+
+  """
+  Calls through function pointers. INDIRECT_CALL(fn) in the source leaves
+  (address, fn) in .indirect_calls, and the kernel marks its calls into the
+  task table with (address, offset of the TaskConf_t field) in .task_callbacks.
+  Each applies to the first blx at or after the address, in the same function.
+
+  The tasks themselves come from task_table and task_count, laid out as
+  .task_layout says: sizeof(TaskConf_t) and the offsets of name, stack,
+  stack_size, job, check and backup. Tasks run on their own stacks, started
+  at _task_entry() (or _idle_entry() for the idle task and coroutines), so
+  those are analysed as roots as well as the exception vectors.
+  """
+  function_starts = sorted(start_end_name_map)
+
+  def next_blx(addr):
+    f = function_starts[bisect.bisect_right(function_starts, addr) - 1]
+    i = find_instruction(addr)
+    while i < len(instructions) and instructions[i].addr < start_end_name_map[f][1]:
+      if instructions[i].name == 'blx':
+        return instructions[i].addr
+      i += 1
+    return None
+
+  blx_targets = {}  # blx address: set of function starts
+  blx_fields = {}   # blx address: TaskConf_t offset
+  for (addr, target) in load_annotations('.indirect_calls'):
+    blx = next_blx(addr)
+    if blx != None:
+      blx_targets.setdefault(blx, set()).add(target & ~1)
+
+  class Task:
+    def __init__(self, name, stack, stack_size, callbacks):
+      self.name = name
+      self.stack = stack
+      self.stack_size = stack_size
+      self.callbacks = callbacks # TaskConf_t offset: function start
+
+  tasks = []
+  task_callbacks = load_annotations('.task_callbacks')
+  task_layout = dump_section('.task_layout')
+  job_fields = backup_fields = () # TaskConf_t offsets of the callbacks a job, or a backup, runs
+  try:
+    if len(task_layout) >= 28:
+      (conf_size, name_offset, stack_offset, size_offset, job, check, backup) = array.array(UINT32, task_layout[:28])
+      (job_fields, backup_fields) = ((job, check), (backup,))
+      table = name_start_end_map['task_table'][1]
+      for k in range(read_memory(name_start_end_map['task_count'][1], 1)[0]):
+        conf = table + k * conf_size
+        name = read_memory(read_word(conf + name_offset), 64).split(b'\0')[0].decode('ascii', 'replace')
+        stack = read_word(conf + stack_offset)
+        stack_size = int.from_bytes(read_memory(conf + size_offset, 2), 'little')
+        callbacks = { offset: read_word(conf + offset) & ~1 for (_, offset) in task_callbacks }
+        tasks.append(Task(name, stack, stack_size, { o: f for o, f in callbacks.items() if f != 0 }))
+  except (KeyError, IndexError) as x:
+    warning_stack += [f'** Warning: Could not read task_table ({x}) **']
+
+  for (addr, offset) in task_callbacks:
+    blx = next_blx(addr)
+    if blx != None:
+      blx_fields[blx] = offset
+      blx_targets.setdefault(blx, set()).update(t.callbacks[offset] for t in tasks if offset in t.callbacks)
+
+  task_roots = set(start for (start, _, name) in start_end_name_map.values() if name.split('.')[0] in ('_task_entry', '_idle_entry'))
+
+  debugprint('Indirect calls: ' + ', '.join(f'0x{a:08X} -> [' + ', '.join(f'0x{f:08X}' for f in t) + ']' for a, t in blx_targets.items()))
+
   """
   Parse the functions starting at the exception entrypoints given by the exception table
   """
 
+  task_report = []
   if len(exception_table) == 0:
     used_stack = 0
     error_stack = f' ** Error: Could not find exception table **'
@@ -482,7 +731,7 @@ with open(stack_file, 'w+') as logfile:
     vectors = set(x for x in exception_table[1:] if x != 0)
 
     debugprint('\n>> PARSING FUNCTIONS <<\n')
-    for v in vectors:
+    for v in sorted(vectors | task_roots):
       try:
         parse_function(v)
       except RuntimeError as x:
@@ -496,30 +745,484 @@ with open(stack_file, 'w+') as logfile:
       logprint('\n>> STACK ANALYSIS RESULTS <<\n')
       logprint(align(f.pretty_print() for f in functions.values()))
 
-      # Find Reset, Hardfault, and maxmimum other exception stack for those which exist. Reset always exists or error.
-      other_exceptions = ([exception_table[2]] + (exception_table[4:] if len(exception_table) > 4 else []) if len(exception_table) > 2 else [])
+      """
+      Interrupt nesting. An exception only preempts ones at a lower priority
+      (a higher number), so the main stack holds at most one handler per NVIC
+      priority level (0-3 on the M0+), with NMI (-2) and HardFault (-1) on top.
+      Priorities come from IRQ_PRIORITY() (src/common/analysis.h), which
+      leaves (exception number, priority) in .irq_priorities. Anything without
+      one is at the reset priority, 0.
+
+      Each level adds the largest handler at that level plus its hardware frame
+      (32, 36 if it has to realign). Once the kernel runs, the first frame goes
+      on the task's stack instead, but main() can take interrupts before that
+      so it's counted here. PendSV's r4-r11 go on the task's stack too, so
+      here it's just the handler and kernel_switch().
+      """
+      EXCEPTION_FRAME = 32 + 4
+      NMI, HARDFAULT = 2, 3
+
+      raw = dump_section('.irq_priorities')
+      words = array.array(UINT32, raw[:len(raw) // 8 * 8])
+      irq_priorities = { words[i]: words[i + 1] for i in range(0, len(words), 2) }
+      irq_priorities.update({ NMI: -2, HARDFAULT: -1 })
+
+      # priority: largest handler
+      levels = {}
+      for n, v in enumerate(exception_table):
+        if n < NMI or v == 0 or v not in functions: continue
+        p = irq_priorities.get(n, 0)
+        if p not in levels or functions[v].total_stack > levels[p].total_stack:
+          levels[p] = functions[v]
+        debugprint(f'Exception {n}: {functions[v].name}, priority {p}')
 
       reset_vector = functions[exception_table[1]]
-      hardfault_vector = functions[exception_table[3]] if len(exception_table) > 3 and exception_table[3] != 0 else None
-      max_vector = max((functions[x] for x in other_exceptions if x != 0), key=lambda x: x.total_stack) if len(other_exceptions) > 0 else None
-
-      INTERRUPT_STACK = 32
       used_stack = reset_vector.total_stack
       critical_path_str = '    -> ' + reset_vector.critical_path_str()
-      if max_vector != None:
-        used_stack += INTERRUPT_STACK + max_vector.total_stack
-        critical_path_str += '\n    -> Interrupt(32) + ' + max_vector.critical_path_str()
-      if hardfault_vector != None:
-        used_stack += INTERRUPT_STACK + hardfault_vector.total_stack
-        critical_path_str += '\n    -> Interrupt(32) + ' + hardfault_vector.critical_path_str()
+      for p in sorted(levels, reverse=True):
+        used_stack += EXCEPTION_FRAME + levels[p].total_stack
+        critical_path_str += f'\n    -> Priority {p} ({EXCEPTION_FRAME}) + ' + levels[p].critical_path_str()
+
+      """
+      Task stacks. A task runs _task_entry() with only its own callbacks, on
+      top of the frame a context switch leaves below it: the hardware frame
+      and r4-r11 (32) from pendsv.s. Interrupts
+      use the main stack, only their hardware frame lands here, and that's the
+      same frame. Tasks sharing a stack get the largest of them. Coroutines
+      all run on the idle stack, under _idle_entry().
+      """
+      SWITCH_FRAME = EXCEPTION_FRAME + 32
+
+      def task_stack(f, task):
+        paths = [task_stack(functions[c], task) for c in f.direct_callees]
+        paths += [functions[task.callbacks[o]].total_stack for o in f.fields if o in task.callbacks]
+        return f.stack + max(paths, default=0)
+
+      def root(prefix):
+        return next((functions[r] for r in sorted(task_roots) if start_end_name_map[r][2].startswith(prefix)), None)
+
+      # stack address: [needed, allocated, symbol, [task names], fix]
+      task_stacks = {}
+      task_entry = root('_task_entry')
+      idle_entry = root('_idle_entry')
+      for task in tasks:
+        if task.stack == 0 or task_entry == None: # Coroutine
+          continue
+        need = task_stack(task_entry, task) + SWITCH_FRAME
+        symbol = start_end_name_map[task.stack][2].split('.')[0] if task.stack in start_end_name_map else f'0x{task.stack:08X}'
+        entry = task_stacks.setdefault(task.stack, [0, task.stack_size, symbol, [], None])
+        entry[0] = max(entry[0], need)
+        entry[1] = min(entry[1], task.stack_size)
+        entry[3].append(task.name)
+        entry[4] = f'TASK_STACK({symbol}, {(entry[0] + 7) // 8 * 8})'
+
+      idle_stack = next((m for m in name_start_end_map.values() if m[0].split('.')[0] == 'idle_stack'), None)
+      if idle_entry != None and idle_stack != None:
+        coroutines = [t.name for t in tasks if t.stack == 0]
+        need = idle_entry.total_stack + SWITCH_FRAME
+        task_stacks[idle_stack[1]] = [need, idle_stack[2] - idle_stack[1], 'idle_stack', ['idle'] + coroutines, f'KERNEL_IDLE_STACK_SIZE ({(need + 7) // 8 * 8})']
+
+      for (need, allocated, symbol, names, fix) in task_stacks.values():
+        task_report.append((symbol, need, allocated, ', '.join(names), fix))
+        logprint(f'Task stack {symbol} ({", ".join(names)}): needs {need}, has {allocated}. {fix}')
 
 
 
 
+  """
+  WCET analysis. Worst case execution time of every function in CPU cycles,
+  for TaskConf_t.wcet and backup_wcet, worked out from the same disassembly.
+
+  Instruction timings are the Cortex-M0+ ones (ARM DDI 0484, table 3-1), same
+  as switch_cycles.py. Flash runs with NVMCTRL_CTRLB_RWS_DUAL wait states (see
+  _conf_clocks()), and every flash access is assumed to miss the NVM cache:
+  each 32 bit fetch, the refetch after a taken branch and each literal load
+  pay the wait states. .ramfunc code in SRAM doesn't. Calls between the two go
+  through a linker veneer, which is counted like any other function.
+
+  Branches are taken whichever way is longer. Loops need a bound, given in the
+  source with LOOP_BOUND() (src/common/analysis.h), which leaves (address, n)
+  pairs in .loop_bounds. Each bound goes to the innermost loop around its
+  address. Loops are collapsed innermost first into n times their longest
+  iteration, then the function is the longest path through what's left,
+  calls included.
+
+  A function is unbounded if it has a loop without a bound, recursion, an
+  indirect call (blx) without INDIRECT_CALL() or an indirect jump. Calls into
+  the task table count as the slowest task's callback. It's listed with the reason.
+  Interrupts landing in the middle aren't included. Paths stop at WCET_END(),
+  what comes after it isn't counted.
+
+  Results go in the log, and per task in program.wcet.h (see task WCETs
+  below). preempt_threshold.py also picks them up from the log.
+  """
+
+  WAIT_STATES = 2 # NVMCTRL_CTRLB_RWS_DUAL_Val
+  RAM_START = 0x20000000
+  EXIT = -1
+
+  COND_BRANCHES = [b for b in BRANCHES if b not in ('b', 'bal')]
+
+  wcet_functions = { start: name for (start, end, name, is_function) in symbols if is_function and start in start_end_name_map }
+
+  loop_bounds = load_annotations('.loop_bounds')
+  wcet_ends = set(addr for (addr, _) in load_annotations('.wcet_ends'))
+
+  def popcount(x):
+    return x.bit_count()
+
+  # Cycles with zero wait states, branches taken
+  def base_cycles(inst, name):
+    if name in ('mrs', 'msr', 'isb', 'dsb', 'dmb', 'bl'): return 3
+    if name in ('bx', 'blx') or name in BRANCHES: return 2
+    if name == 'push': return 1 + popcount(inst.data & 0x1FF)
+    if name == 'pop': return (3 if inst.data & 0x100 else 1) + popcount(inst.data & 0x1FF)
+    if name.startswith(('ldm', 'stm')): return 1 + popcount(inst.data & 0xFF)
+    if name.startswith(('ldr', 'str')): return 2
+    return 1
+
+  # Share of a function's own cycles that are flash wait states when it's in
+  # flash, each instruction counted once. What running it from RAM saves per
+  # cycle spent in it, for PC sampled profiles (scripts/ramfunc.py).
+  def wait_share(start):
+    (_, end, _) = start_end_name_map[start]
+    cycles = waits = 0
+    i = find_instruction(start)
+    while i < len(instructions) and instructions[i].addr < end:
+      inst = instructions[i]
+      op = inst.name.split('.')[0]
+      i += 1
+      if op.startswith('.'): continue
+      refetch = op in ('bl', 'blx', 'bx') or op in BRANCHES or (op == 'pop' and inst.data & 0x100 != 0)
+      literal = op == 'ldr' and inst.len == 2 and inst.data & 0xF800 == 0x4800
+      cycles += base_cycles(inst, op)
+      waits += WAIT_STATES * (inst.len / 4 + refetch + literal)
+    return round(waits / (cycles + waits), 3) if cycles else 0
+
+  # start: (cycles, None) or (None, reason), Function.WIP while being worked out
+  wcets = {}
+
+  class Unbounded(Exception):
+    pass
+
+  def wcet_function(start):
+    if start in wcets:
+      if wcets[start] == Function.WIP:
+        return (None, f'recursion through {start_end_name_map[start][2]}')
+      return wcets[start]
+    wcets[start] = Function.WIP
+    wcets[start] = analyse_wcet(start)
+    return wcets[start]
+
+  # wait overrides the function's own wait states (not its callees'), for
+  # what it would take from RAM. calls (TaskConf_t offset: function start)
+  # narrows calls into the task table down to one task's callbacks, the rest
+  # count as not taken.
+  def analyse_wcet(start, wait=None, calls=None):
+    (_, end, name) = start_end_name_map[start]
+    if wait == None:
+      wait = WAIT_STATES if start < RAM_START else 0
+
+    body = []
+    i = find_instruction(start)
+    while i < len(instructions) and instructions[i].addr < end:
+      if not instructions[i].name.startswith('.'): # Literal pools
+        body.append(instructions[i])
+      i += 1
+    if not body:
+      return (None, 'no code')
+    index = { inst.addr: k for k, inst in enumerate(body) }
+
+    # Instruction level CFG: weight and successors (indices, or EXIT), and
+    # why each instruction that can't be bounded can't
+    weight = []
+    succ = []
+    bad = {}
+    for k, inst in enumerate(body):
+      try:
+        op = inst.name.split('.')[0]
+        w = base_cycles(inst, op) + wait * inst.len / 4
+        nxt = [k + 1] if k + 1 < len(body) else [EXIT]
+        target = branch_target(inst)
+
+        if op == 'bl':
+          if target in index: # Long branch within the function
+            nxt = [index[target]]
+          elif target in wcet_functions:
+            callee = wcet_functions[target]
+            if callee.startswith('__gnu_thumb1_case'):
+              raise Unbounded(f'switch table at 0x{inst.addr:08X}')
+            (cycles, reason) = wcet_function(target)
+            if cycles == None:
+              raise Unbounded(f'calls {callee}: {reason}')
+            w += cycles
+          else:
+            raise Unbounded(f'unknown bl target at 0x{inst.addr:08X}')
+          w += wait
+
+        elif op == 'blx':
+          if calls != None and inst.addr in blx_fields:
+            targets = [calls[blx_fields[inst.addr]]] if blx_fields[inst.addr] in calls else []
+          elif inst.addr in blx_targets:
+            targets = blx_targets[inst.addr]
+          else:
+            raise Unbounded(f'indirect call at 0x{inst.addr:08X}')
+          worst = 0
+          for target in targets:
+            (cycles, reason) = wcet_function(target) if target in wcet_functions else (None, f'unknown blx target 0x{target:08X}')
+            if cycles == None:
+              raise Unbounded(f'calls {start_end_name_map.get(target, (0, 0, hex(target)))[2]}: {reason}')
+            worst = max(worst, cycles)
+          w += worst + wait
+
+        elif op == 'bx' and start in veneers:
+          (cycles, reason) = wcet_function(veneers[start])
+          if cycles == None:
+            raise Unbounded(f'calls {start_end_name_map[veneers[start]][2]}: {reason}')
+          nxt = [EXIT]
+          w += cycles + wait
+
+        elif op == 'bx':
+          if inst.arg0 != 'lr' and start not in exception_table[1:]: # Handlers can return through any register (pendsv.s)
+            raise Unbounded(f'indirect jump at 0x{inst.addr:08X}')
+          nxt = [EXIT]
+          w += wait
+
+        elif op == 'pop' and inst.data & 0x100:
+          nxt = [EXIT]
+          w += wait
+
+        elif op in BRANCHES and target != None:
+          w += wait
+          if target in index:
+            taken = [index[target]]
+          else: # Tail call
+            (cycles, reason) = wcet_function(target) if target in wcet_functions else (None, f'unknown branch target at 0x{inst.addr:08X}')
+            if cycles == None:
+              raise Unbounded(reason)
+            w += cycles
+            taken = [EXIT]
+          nxt = taken + nxt if op in COND_BRANCHES else taken
+
+        elif inst.arg0 == 'pc' and op in ('mov', 'add'):
+          raise Unbounded(f'indirect jump at 0x{inst.addr:08X}')
+
+        elif op == 'ldr' and inst.len == 2 and inst.data & 0xF800 == 0x4800: # Literal load
+          w += wait
+
+        elif op in ('udf', 'bkpt'):
+          nxt = [EXIT]
+
+      except Unbounded as x: # Only if it's reachable, see below
+        (w, nxt) = (0, [EXIT])
+        bad[k] = x.args[0]
+
+      weight.append(w)
+      succ.append(nxt)
+
+    # Cut at WCET_END(), then drop what can't be reached any more
+    ends = set(index[addr] for addr in wcet_ends if addr in index)
+    succ = [[EXIT if s in ends else s for s in nxt] for nxt in succ]
+    live = set()
+    todo = [0]
+    while todo:
+      k = todo.pop()
+      if k != EXIT and k not in live:
+        live.add(k)
+        todo += succ[k]
+    reason = next((bad[k] for k in sorted(live) if k in bad), None)
+    if reason != None:
+      return (None, reason)
+
+    # Loops from back edges, partial overlaps merged
+    regions = {}
+    for k in sorted(live):
+      for s in succ[k]:
+        if 0 <= s <= k:
+          regions[s] = max(regions.get(s, s), k)
+    merged = True
+    while merged:
+      merged = False
+      for h1, t1 in list(regions.items()):
+        for h2, t2 in list(regions.items()):
+          if h1 < h2 <= t1 < t2:
+            regions[h1] = t2
+            del regions[h2]
+            merged = True
+            break
+        if merged: break
+
+    bounds = {}
+    for (addr, n) in loop_bounds:
+      if start <= addr < end:
+        k = bisect.bisect_left(body, addr, key=operator.attrgetter('addr'))
+        around = [h for h, t in regions.items() if h <= k <= t]
+        if around:
+          h = max(around)
+          bounds[h] = min(bounds.get(h, n), n)
+
+    # Collapse loops, innermost first
+    rep = list(range(len(body)))
+    def find(k):
+      while k != EXIT and rep[k] != k:
+        k = rep[k]
+      return k
+
+    for h, t in sorted(regions.items(), key=lambda r: r[1] - r[0]):
+      if h not in bounds:
+        return (None, f'loop at 0x{body[h].addr:08X} has no LOOP_BOUND()')
+
+      nodes = sorted(set(find(k) for k in range(h, t + 1) if k in live))
+      inside = lambda s: s != EXIT and h <= s <= t
+
+      # Longest path from the head back round to it, and from anywhere to an exit
+      wrap = {}
+      to_exit = {}
+      for u in reversed(nodes):
+        fwd = [find(s) for s in succ[u] if inside(s) and find(s) > u]
+        ends_wrap = [0] if any(inside(s) and find(s) <= u for s in succ[u]) else []
+        ends_exit = [0] if any(not inside(s) for s in succ[u]) else []
+        paths = [wrap[v] for v in fwd if wrap[v] != None] + ends_wrap
+        wrap[u] = weight[u] + max(paths) if paths else None
+        paths = [to_exit[v] for v in fwd if to_exit[v] != None] + ends_exit
+        to_exit[u] = weight[u] + max(paths) if paths else None
+
+      entries = set(find(s) for u in set(find(k) for k in live) if not inside(u) for s in succ[u] if inside(s))
+      if h == 0:
+        entries.add(h)
+      exits = set(s for u in nodes for s in succ[u] if not inside(s))
+      tail_only = all(u == find(t) for u in nodes if any(not inside(s) for s in succ[u]))
+
+      # A loop tested at the bottom and entered at the top wraps round one
+      # time less than its body runs
+      n = max(bounds[h], 1)
+      wraps = n - 1 if tail_only and entries == { h } else n
+      exit_path = max((to_exit[e] for e in entries if to_exit[e] != None), default=0)
+
+      weight[h] = wraps * (wrap[h] or 0) + exit_path
+      succ[h] = list(exits)
+      for u in nodes:
+        if u != h:
+          rep[u] = h
+
+    # Longest path through the rest
+    total = {}
+    for u in reversed(sorted(set(find(k) for k in live))):
+      paths = []
+      for s in succ[u]:
+        v = find(s)
+        if v == EXIT:
+          paths.append(0)
+        elif v <= u:
+          return (None, f'irreducible loop at 0x{body[u].addr:08X}')
+        else:
+          paths.append(total[v])
+      total[u] = weight[u] + max(paths, default=0)
+
+    return (math.ceil(total[find(0)]), None)
+
+  wcet_log = []
+  wcet_unbounded = 0
+  for start, name in sorted(wcet_functions.items()):
+    try:
+      (cycles, reason) = wcet_function(start)
+    except (KeyError, IndexError) as x:
+      (cycles, reason) = (None, f'could not analyse ({x})')
+
+    if reason == 'no code': # Data in .text
+      continue
+
+    if cycles == None:
+      wcet_unbounded += 1
+      wcet_log.append((f'WCET {name}[{hex(start)}]:', 'unbounded', f'{reason}\n'))
+    else:
+      wcet_log.append((f'WCET {name}[{hex(start)}]:', f'{cycles} cycles', f'{us(cycles)}\n'))
+
+  wcet_counted = len(wcet_log)
+
+  """
+  Task WCETs, for TaskConf_t.wcet and backup_wcet. A job's budget is charged
+  from the switch to it until _job_done(), so on top of its callbacks that's
+  _task_entry() with only this task's job and check (or backup) up to
+  WCET_END(), a PendSV switch (PendSV_Handler and kernel_switch()) and a
+  budget interrupt (TC4_Handler and kernel_budget_expired()), each with
+  exception entry and return. Ticks and further switches from preemption
+  aren't included. Coroutines are stepped from _idle_entry() and get no
+  figure, their step is in the log like any other function.
+
+  These go in program.wcet.h as WCET_<task> and WCET_<task>_backup, which the
+  Makefile force-includes. It's only rewritten when a figure changes, so
+  builds that don't change one don't rebuild everything.
+  """
+  EXCEPTION_CYCLES = 15 + 15 + 2 * WAIT_STATES # Entry and return (switch_cycles.py), the vector and return fetches miss
+
+  def overhead(handler):
+    if handler not in name_start_end_map:
+      return (None, f'no {handler}')
+    (cycles, reason) = wcets.get(name_start_end_map[handler][1], (None, 'not analysed'))
+    return (cycles + EXCEPTION_CYCLES, None) if cycles != None else (None, f'{handler}: {reason}')
+
+  wcet_tasks = []
+  task_entry_start = next((r for r in sorted(task_roots) if start_end_name_map[r][2].startswith('_task_entry')), None)
+  for task in tasks:
+    for (suffix, fields) in (('', job_fields), ('_backup', backup_fields)):
+      if task.stack == 0 or not any(o in task.callbacks for o in fields):
+        continue
+      parts = [overhead('PendSV_Handler'), overhead('TC4_Handler')]
+      if task_entry_start == None:
+        parts.append((None, 'no _task_entry'))
+      else:
+        try:
+          (cycles, reason) = analyse_wcet(task_entry_start, calls={ o: task.callbacks[o] for o in fields if o in task.callbacks })
+          parts.append((cycles, None) if cycles != None else (None, f'_task_entry: {reason}'))
+        except (KeyError, IndexError) as x:
+          parts.append((None, f'could not analyse _task_entry ({x})'))
+
+      name = f'{task.name}{suffix}'
+      reason = next((r for (_, r) in parts if r != None), None)
+      if reason != None:
+        wcet_log.append((f'WCET task {name}:', 'unbounded', f'{reason}\n'))
+        continue
+      cycles = sum(c for (c, _) in parts)
+      wcet_log.append((f'WCET task {name}:', f'{cycles} cycles', f'{us(cycles)}\n'))
+      wcet_tasks.append(f'#define WCET_{re.sub(r"[^A-Za-z0-9_]", "_", name)} ({cycles}u)')
+
+  logprint('\n>> WCET ANALYSIS RESULTS <<\n')
+  logprint(align(wcet_log))
+
+  header_file = elf_file.replace('.elf', '.wcet.h')
+  header = '\n'.join([
+    f'// Generated by scripts/stack_analyze.py from {os.path.basename(elf_file)}, do not edit.',
+    '// Worst case execution times in CPU cycles, for TaskConf_t.wcet and backup_wcet.',
+    '#ifndef _WCET_H\n#define _WCET_H\n',
+    *wcet_tasks,
+    '\n#endif\n'])
+  try:
+    with open(header_file) as f:
+      stale = f.read() != header
+  except OSError:
+    stale = True
+  if stale:
+    with open(header_file, 'w') as f:
+      f.write(header)
+
+
   """
   Print resource summary usage for flash, sram, and stack.
+  Changes since the last run come from the previous JSON report.
   """
 
+  report_file = elf_file.replace('.elf', '.stack.json')
+  try:
+    with open(report_file) as f:
+      last_report = json.load(f)
+  except (OSError, ValueError):
+    last_report = {}
+
+  def since_last(key, used):
+    last = (last_report.get(key) or {}).get('used') # None if it failed last time
+    return f', {used - last:+d} since last build' if last != None and used != last else ''
+
   uprint(f'-- Resource Usage Summary for {elf_file} --')
   error_flash = ""
   error_sram = ""
@@ -555,7 +1258,7 @@ with open(stack_file, 'w+') as logfile:
     usage_flash = (1 if used_flash == 0 else float('inf')) if total_flash == 0 else used_flash / total_flash
     color_flash = WHITE if usage_flash < 0.8 else ORANGE if usage_flash <= 1 else RED
     if color_flash == RED: error_flash = '** Stack usage out of bounds **'
-    uprint(f'  FLASH: {usage_flash:0.2%} ({used_flash} / {total_flash})', color=color_flash)
+    uprint(f'  FLASH: {usage_flash:0.2%} ({used_flash} / {total_flash}{since_last("flash", used_flash)})', color=color_flash)
   else:
     uprint(f'  FLASH: ??? / ??? {error_flash}', color=RED)
 
@@ -563,7 +1266,7 @@ with open(stack_file, 'w+') as logfile:
     usage_sram = (1 if used_sram == 0 else float('inf')) if total_sram == 0 else used_sram / total_sram
     color_sram = WHITE if usage_sram < 0.8 else ORANGE if usage_sram <= 1 else RED
     if color_sram == RED: error_sram = '** Stack usage out of bounds **'
-    uprint(f'  SRAM:  {usage_sram:0.2%} ({used_sram} / {total_sram})', color=color_sram)
+    uprint(f'  SRAM:  {usage_sram:0.2%} ({used_sram} / {total_sram}{since_last("sram", used_sram)})', color=color_sram)
   else:
     uprint(f'  SRAM: ??? / ??? {error_sram}', color=RED)
 
@@ -571,11 +1274,111 @@ with open(stack_file, 'w+') as logfile:
     usage_stack = (1 if used_stack == 0 else float('inf')) if total_stack == 0 else used_stack / total_stack
     color_stack = WHITE if usage_stack < 0.5 else ORANGE if usage_stack <= 1 else RED
     if color_stack == RED: error_stack = '** Stack usage out of bounds **'
-    uprint(f'  STACK: {usage_stack:0.2%} ({used_stack} / {total_stack})', color=color_stack)
+    uprint(f'  STACK: {usage_stack:0.2%} ({used_stack} / {total_stack}{since_last("stack", used_stack)})', color=color_stack)
     if warning_stack:
       uprint('\n'.join('    ' + i for i in warning_stack), color=ORANGE)
     uprint(critical_path_str)
+    if task_report:
+      uprint(f'  TASKS: stack needed / allocated, including the {SWITCH_FRAME} byte switch frame')
+      for (symbol, need, allocated, names, fix) in task_report:
+        uprint(f'    {symbol:<20} {need:>5} / {allocated:<5} {names}', color=RED if need > allocated else None)
+        if need > allocated:
+          uprint(f'    ** Task stack too small, use {fix} **', color=RED)
   else:
     uprint(f'  STACK: ??? / ??? {error_stack}', color=RED)
 
-  exit(bool(error_flash or error_sram or error_stack))
\ No newline at end of file
+  uprint(f'  WCET:  {wcet_counted} functions, {wcet_unbounded} unbounded, {len(wcet_tasks)} tasks (see {os.path.basename(stack_file)}, {os.path.basename(header_file)})')
+
+
+  """
+  Stack sizes fitted to the analysis, worst case plus a margin, rounded up
+  to 8 (AAPCS). Reported every run, written out with --fit. Task stacks are
+  C arrays, so their sizes go through a header for TASK_STACK rather than
+  the linker.
+
+  --fit refuses while there are warnings: an indirect call it couldn't
+  follow, a bl it couldn't resolve or an unreadable task_table all leave
+  some stack out of the worst case, and a fit would shrink it to that.
+  """
+  margin = fit_margin if fit_margin != None else 32
+  fit = lambda need: (need + margin + 7) // 8 * 8
+  error_fit = ''
+
+  if not error_stack:
+    fitted = [(symbol, fit(need), allocated, need) for (symbol, need, allocated, names, _) in task_report]
+    freed = total_stack - fit(used_stack) + sum(allocated - size for (_, size, allocated, _) in fitted)
+    uprint(f'  FIT:   main stack {fit(used_stack)}, ' + ', '.join(f'{symbol} {size}' for (symbol, size, _, _) in fitted) +
+      f' with a {margin} byte margin, ' + (f'frees {freed}' if freed >= 0 else f'takes {-freed} more') + ' bytes of SRAM' +
+      ('' if fit_margin != None else ' (make stack-fit)'))
+
+    if fit_margin != None and warning_stack:
+      error_fit = '** Not fitting stacks with warnings in the analysis, see above **'
+      uprint(f'    {error_fit}', color=RED)
+    elif fit_margin != None:
+      sizes_dir = os.path.dirname(elf_file)
+      with open(os.path.join(sizes_dir, 'stack_sizes.ld'), 'w') as f:
+        print(f'/* Generated by scripts/stack_analyze.py from {os.path.basename(elf_file)}, do not edit. */', file=f)
+        print(f'STACK_SIZE = {fit(used_stack)}; /* {used_stack} needed */', file=f)
+      with open(os.path.join(sizes_dir, 'stack_sizes.h'), 'w') as f:
+        print(f'// Generated by scripts/stack_analyze.py from {os.path.basename(elf_file)}, do not edit.', file=f)
+        print(f'// Stack sizes in bytes, the analysed worst case plus {margin}. See TASK_STACK.', file=f)
+        print('#ifndef _STACK_SIZES_H\n#define _STACK_SIZES_H\n', file=f)
+        for (symbol, size, _, need) in fitted:
+          if symbol == 'idle_stack':
+            print(f'#define KERNEL_IDLE_STACK_SIZE ({size}) // {need} needed', file=f)
+          else:
+            print(f'#define STACK_SIZE_{symbol} _, {size} // {need} needed', file=f)
+        print('\n#endif', file=f)
+
+
+  """
+  JSON report, for tools and for diffing builds: FLASH/SRAM/STACK usage, and
+  per function its flash size, own and worst case stack, calls and WCET.
+  Stack figures are only there for functions reachable from a vector or task.
+  wcet_flash and wcet_ram are the WCET with the function itself in flash or
+  in RAM, wherever it is now, callees left where they are. wait_share is the
+  share of its own cycles that are flash wait states when it's in flash.
+  cpu_hz and tick_hz are the kernel's, null without it. scripts/ramfunc.py
+  and scripts/preempt_threshold.py go by these.
+  """
+  report = {
+    'elf': os.path.basename(elf_file),
+    'cpu_hz': cpu_hz,
+    'tick_hz': tick_hz,
+    'flash': { 'used': used_flash, 'total': total_flash } if not error_flash else None,
+    'sram': { 'used': used_sram, 'total': total_sram } if not error_sram else None,
+    'stack': { 'used': used_stack, 'total': total_stack } if not error_stack else None,
+    'tasks': [{ 'stack': symbol, 'needed': need, 'allocated': allocated, 'tasks': names.split(', ') } for (symbol, need, allocated, names, fix) in task_report],
+    'functions': {},
+  }
+  for start in code_starts:
+    f = functions.get(start)
+    parsed = isinstance(f, Function)
+    (cycles, reason) = wcets[start] if isinstance(wcets.get(start), tuple) else (None, None)
+    try:
+      (cycles_flash, _) = analyse_wcet(start, WAIT_STATES) if cycles != None else (None, None)
+      (cycles_ram, _) = analyse_wcet(start, 0) if cycles != None else (None, None)
+    except (KeyError, IndexError):
+      (cycles_flash, cycles_ram) = (None, None)
+    report['functions'][start_end_name_map[start][2]] = {
+      'address': start,
+      'size': code[start][0] - start,
+      'stack': f.stack if parsed else None,
+      'total_stack': f.total_stack if parsed else None,
+      'calls': sorted(set(functions[c].name for c in f.callees)) if parsed else [],
+      'wcet': cycles,
+      'wcet_flash': cycles_flash,
+      'wcet_ram': cycles_ram,
+      'wait_share': wait_share(start),
+    }
+
+  # What moved, in the log
+  for name, now in report['functions'].items():
+    last = last_report.get('functions', {}).get(name)
+    if last and (last['size'], last['total_stack']) != (now['size'], now['total_stack']):
+      logprint(f'Changed since last build: {name} size {last["size"]} -> {now["size"]}, stack {last["total_stack"]} -> {now["total_stack"]}')
+
+  with open(report_file, 'w') as f:
+    json.dump(report, f, indent=1)
+
+  exit(bool(error_flash or error_sram or error_stack or error_fit))
\ No newline at end of file
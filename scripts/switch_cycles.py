@@ -0,0 +1,160 @@
+import re
+import sys
+import subprocess
+
+"""
+Cycle model of the PendSV context switch (src/kernel/pendsv.s).
+Pass arguments: python3 switch_cycles.py program.elf [self self_kernel]
+
+self and self_kernel are the bench_switch figures from the
+microbenchmark (make bench-switch, src/bench/switch.c). If given, the
+measured cost of a yield to the same task is checked against the model.
+
+Instruction timings are the published Cortex-M0+ ones (ARM DDI 0484,
+table 3-1), exception entry and return are 15 cycles each with zero
+wait state memory. Those all assume single cycle instruction fetches.
+
+Flash runs with NVMCTRL->CTRLB.RWS = 2 wait states (_conf_clocks()).
+The core fetches 32 bits, two Thumb instructions, at a time, and each
+fetch from flash stalls for the wait states unless it hits the NVM
+cache. So the model gives a range: best case every fetch hits the
+cache, worst case every fetch misses. Stack accesses go to SRAM and
+never wait.
+"""
+
+objdump = 'arm-none-eabi-objdump'
+
+WAIT_STATES = 2
+ENTRY = 15
+RETURN = 15
+
+# port_yield() (literal load + store to ICSR) and the __ISB() after it,
+# both inside the bench's self measurement
+YIELD = 2 + 2 + 3
+
+# kernel_switch() is timed through a wrapper, whose own call, SysTick
+# reads and return land in the asm share. Allow that much slack.
+WRAPPER_SLACK = 12
+
+RED = '\033[91m'
+WHITE = '\033[0m'
+
+
+class Instruction:
+  def __init__(self, addr, size, name, args):
+    self.addr = addr
+    self.size = size
+    self.name = name
+    self.args = args
+
+  def regs(self):
+    m = re.search(r'\{(.*)\}', self.args)
+    count = 0
+    for r in m[1].split(','):
+      r = r.strip()
+      if '-' in r:
+        lo, hi = (int(x.strip()[1:]) for x in r.split('-'))
+        count += hi - lo + 1
+      else:
+        count += 1
+    return count
+
+  """
+  Cycles on the M0+ with zero wait states. branch_taken only matters for
+  conditional branches.
+  """
+  def cycles(self, branch_taken):
+    n = self.name
+    if n in ('mrs', 'msr', 'isb', 'dsb', 'dmb'): return 3
+    if n in ('bl',): return 3
+    if n in ('bx', 'blx', 'b'): return 2
+    if re.fullmatch(r'b(eq|ne|cs|hs|cc|lo|mi|pl|vs|vc|hi|ls|ge|lt|gt|le)', n): return 2 if branch_taken else 1
+    if n in ('push',): return 1 + self.regs()
+    if n in ('pop',): return (3 if 'pc' in self.args else 1) + self.regs()
+    if n.startswith(('ldm', 'stm')): return 1 + self.regs()
+    if n.startswith(('ldr', 'str')): return 2
+    return 1
+
+  def is_branch(self):
+    return self.name in ('b', 'bx') or re.fullmatch(r'b(eq|ne|cs|hs|cc|lo|mi|pl|vs|vc|hi|ls|ge|lt|gt|le)', self.name) != None
+
+  def target(self):
+    m = re.match(r'\s*(0x)?([0-9a-f]+)', self.args)
+    return int(m[2], 16)
+
+
+"""
+Disassemble one function:
+  20c:	f3ef 8009 	mrs	r0, PSP
+"""
+def disassemble(elf, name):
+  out = subprocess.check_output([objdump, '--disassemble=' + name, elf], encoding='ascii')
+  instructions = []
+  for m in re.findall(r'(?m)^\s*([0-9a-f]+):\s+([0-9a-f]{4}(?: [0-9a-f]{4})?)\s+\t(\S+)\s*([^;@\n]*)', out):
+    instructions.append(Instruction(int(m[0], 16), 2 * len(m[1].split()), m[2].split('.')[0], m[3].strip()))
+  if not instructions:
+    print(f'** Error: {name} not found in {elf} **')
+    exit(1)
+  return instructions
+
+
+"""
+Walk one path through the handler, taking conditional branches or not.
+Returns (instructions, cycles, flash fetches). The bl to kernel_switch()
+counts as the call only.
+"""
+def walk(instructions, take_branches):
+  by_addr = { i.addr: i for i in instructions }
+  pc = instructions[0].addr
+  count = cycles = fetches = 0
+  word = None
+
+  while pc in by_addr:
+    i = by_addr[pc]
+    for w in range(i.addr // 4, (i.addr + i.size - 1) // 4 + 1):
+      if w != word:
+        fetches += 1
+        word = w
+
+    taken = i.is_branch() and (i.name in ('b', 'bx') or take_branches)
+    count += 1
+    cycles += i.cycles(taken)
+    if i.name == 'bx':
+      break
+    if taken:
+      pc = i.target()
+      word = None
+    else:
+      pc += i.size
+
+  return count, cycles, fetches
+
+
+def main():
+  elf = sys.argv[1]
+  handler = disassemble(elf, 'PendSV_Handler')
+
+  print(f'PendSV_Handler, {WAIT_STATES} flash wait states, entry/return {ENTRY}/{RETURN} cycles')
+  print(f'{"path":<14}{"instr":>7}{"core":>7}{"fetches":>9}{"best":>7}{"worst":>7}')
+  paths = {}
+  for label, take in (('same task', True), ('switch', False)):
+    count, core, fetches = walk(handler, take)
+    best = ENTRY + core + RETURN
+    # One more flash read each for the vector and the instruction returned to
+    worst = best + WAIT_STATES * (fetches + 2)
+    paths[label] = (best, worst)
+    print(f'{label:<14}{count:>7}{core:>7}{fetches:>9}{best:>7}{worst:>7}')
+
+  if len(sys.argv) > 3:
+    self, self_kernel = int(sys.argv[2]), int(sys.argv[3])
+    measured = self - self_kernel - YIELD
+    best, worst = paths['same task']
+    print(f'\nMeasured same task: {self} - {self_kernel} in kernel_switch() - {YIELD} yield = {measured} cycles')
+    if best <= measured <= worst + WRAPPER_SLACK:
+      print(f'Within the model ({best}..{worst}, +{WRAPPER_SLACK} for the bench wrapper)')
+    else:
+      print(RED + f'Outside the model ({best}..{worst}, +{WRAPPER_SLACK} for the bench wrapper)' + WHITE)
+      exit(1)
+
+
+main()
@@ -0,0 +1,345 @@
+/*
+    Regression test image for scripts/stack_analyze.py, make stack-analyze-test.
+
+    A cut down kernel in the shape of the real one: PendSV_Handler from
+    pendsv.s, a budget interrupt, _task_entry() with annotated calls into a
+    task table, and two tasks, one with a check and a backup. The cycle count
+    next to each instruction is counted by hand from the same model as the
+    analyser (base cycles, 2 flash wait states per 32 bit fetch, per taken
+    branch or return and per literal load, conditional branches always
+    taken). wcet.expected and wcet.wcet.h hold what it should come to.
+
+    wcet.elf is checked in, so the test needs no assembler. After changing
+    this, rebuild it with
+      llvm-mc -triple=thumbv6m-none-eabi -filetype=obj wcet.s -o wcet.o
+      ld.lld -N -e Reset_Handler -Ttext=0 -Tbss=0x20000000 wcet.o -o wcet.elf
+    (arm-none-eabi-as and arm-none-eabi-ld take the same options), then check
+    the analyser against the counts here before updating the expected files.
+*/
+
+  .syntax unified
+  .cpu cortex-m0plus
+  .thumb
+
+  @ Annotations, as in src/common/analysis.h and kernel.c
+  .macro LOOP_BOUND n
+  .pushsection .loop_bounds, "", %progbits
+  .word 9f, \n
+  .popsection
+9:
+  .endm
+
+  .macro TASK_CALLBACK offset
+  .pushsection .task_callbacks, "", %progbits
+  .word 9f, \offset
+  .popsection
+9:
+  .endm
+
+  .macro WCET_END
+  .pushsection .wcet_ends, "", %progbits
+  .word 9f, 0
+  .popsection
+9:
+  .endm
+
+  .macro FUNCTION name
+  .p2align 2
+  .global \name
+  .type \name, %function
+  .thumb_func
+\name:
+  .endm
+
+  @ TaskConf_t: name, job, check, backup, stack, stack_size, flags (backup
+  @ running, really in Task_t), arg, optional
+  .equ CONF_JOB,      4
+  .equ CONF_CHECK,    8
+  .equ CONF_BACKUP,   12
+  .equ CONF_FLAGS,    24
+  .equ CONF_ARG,      28
+  .equ CONF_OPTIONAL, 32
+  .equ CONF_SIZE,     36
+
+  .pushsection .task_layout, "", %progbits
+  .word CONF_SIZE, 0, 16, 20, CONF_JOB, CONF_CHECK, CONF_BACKUP
+  .popsection
+
+  @ KERNEL_CPU_HZ, KERNEL_TICK_HZ
+  .pushsection .kernel_clock, "", %progbits
+  .word 48000000, 1000
+  .popsection
+
+  .text
+
+  .global exception_table
+  .type exception_table, %object
+exception_table:
+  .word _estack
+  .word Reset_Handler
+  .rept 12
+  .word 0
+  .endr
+  .word PendSV_Handler  @ 14
+  .word 0               @ 15, SysTick
+  .rept 19
+  .word 0
+  .endr
+  .word TC4_Handler     @ 16 + TC4_IRQn
+  .size exception_table, . - exception_table
+
+  .global _srom
+_srom = exception_table
+
+@ Unbounded: loop at 0x... has no LOOP_BOUND()
+FUNCTION Reset_Handler
+  b     Reset_Handler
+  .size Reset_Handler, . - Reset_Handler
+
+@ 218 cycles
+FUNCTION PendSV_Handler
+  mrs   r0, psp             @ 5
+  subs  r0, #32             @ 2
+  push  {r0, lr}            @ 4
+  bl    kernel_switch       @ 7 + 135
+  pop   {r1, r2}            @ 4
+  cmp   r0, #0              @ 2
+  beq   1f                  @ 5
+
+  stmia r1!, {r4-r7}        @ 6
+  mov   r4, r8              @ 2
+  mov   r5, r9              @ 2
+  mov   r6, r10             @ 2
+  mov   r7, r11             @ 2
+  stmia r1!, {r4-r7}        @ 6
+
+  adds  r0, #16             @ 2
+  ldmia r0!, {r4-r7}        @ 6
+  mov   r8, r4              @ 2
+  mov   r9, r5              @ 2
+  mov   r10, r6             @ 2
+  mov   r11, r7             @ 2
+  msr   psp, r0             @ 5
+  subs  r0, #32             @ 2
+  ldmia r0!, {r4-r7}        @ 6
+
+1:
+  bx    r2                  @ 5, exception return
+  .size PendSV_Handler, . - PendSV_Handler
+
+@ 4 + 5 + 2 + 2 + 8 * 14 + 2 + 8 = 135 cycles. Bottom tested, entered at
+@ the top, so 7 times round and once out
+FUNCTION kernel_switch
+  push  {r4, lr}            @ 4
+  ldr   r1, =tasks          @ 5
+  movs  r2, #0              @ 2
+  movs  r3, #8              @ 2
+1:
+  LOOP_BOUND 8
+  ldr   r4, [r1]            @ 3
+  adds  r2, r2, r4          @ 2
+  adds  r1, #4              @ 2
+  subs  r3, #1              @ 2
+  bne   1b                  @ 5
+  movs  r0, r2              @ 2
+  pop   {r4, pc}            @ 8
+  .ltorg
+  .size kernel_switch, . - kernel_switch
+
+@ 62 cycles
+FUNCTION TC4_Handler
+  push  {r7, lr}            @ 4
+  ldr   r3, =0x42003000     @ 5, TC4
+  movs  r2, #0x10           @ 2
+  strb  r2, [r3, #0xe]      @ 3, INTFLAG = MC0
+  bl    kernel_budget_expired @ 7 + 33
+  pop   {r7, pc}            @ 8
+  .ltorg
+  .size TC4_Handler, . - TC4_Handler
+
+@ 33 cycles
+FUNCTION kernel_budget_expired
+  ldr   r3, =budget         @ 5
+  ldr   r2, [r3]            @ 3
+  cmp   r2, #0              @ 2
+  bne   1f                  @ 5
+  ldr   r1, =0xE000ED04     @ 5, ICSR
+  ldr   r0, =0x10000000     @ 5, PENDSVSET
+  str   r0, [r1]            @ 3
+1:
+  bx    lr                  @ 5
+  .ltorg
+  .size kernel_budget_expired, . - kernel_budget_expired
+
+@ 18 cycles
+FUNCTION _job_done
+  ldr   r3, =0xE000ED04     @ 5
+  ldr   r2, =0x10000000     @ 5
+  str   r2, [r3]            @ 3
+  bx    lr                  @ 5
+  .ltorg
+  .size _job_done, . - _job_done
+
+@ Backup branch 34, job branch 47 + job + check, then 27 to WCET_END.
+@ With every task's callbacks that's 47 + 159 + 7 + 27 = 240 cycles. The
+@ optional loop after WCET_END has no bound and isn't counted.
+FUNCTION _task_entry
+  push  {r4, r5, r6, lr}    @ 6
+  movs  r4, r0              @ 2
+  ldr   r5, [r4, #CONF_FLAGS] @ 3
+  cmp   r5, #0              @ 2
+  beq   1f                  @ 5
+  ldr   r0, [r4, #CONF_ARG] @ 3
+  ldr   r3, [r4, #CONF_BACKUP] @ 3
+  TASK_CALLBACK CONF_BACKUP
+  blx   r3                  @ 5 + backup
+  b     2f                  @ 5
+1:
+  ldr   r0, [r4, #CONF_ARG] @ 3
+  ldr   r3, [r4, #CONF_JOB] @ 3
+  TASK_CALLBACK CONF_JOB
+  blx   r3                  @ 5 + job
+  ldr   r3, [r4, #CONF_CHECK] @ 3
+  cmp   r3, #0              @ 2
+  beq   2f                  @ 5
+  ldr   r0, [r4, #CONF_ARG] @ 3
+  TASK_CALLBACK CONF_CHECK
+  blx   r3                  @ 5 + check
+2:
+  movs  r0, r4              @ 2
+  bl    _job_done           @ 7 + 18
+  WCET_END
+3:
+  ldr   r0, [r4, #CONF_ARG]
+  ldr   r3, [r4, #CONF_OPTIONAL]
+  TASK_CALLBACK CONF_OPTIONAL
+  blx   r3
+  cmp   r0, #0
+  beq   3b
+  b     .
+  .size _task_entry, . - _task_entry
+
+@ 15 cycles
+FUNCTION blink
+  ldr   r3, =0x41004400     @ 5, PORT
+  movs  r2, #1              @ 2
+  str   r2, [r3, #0x1c]     @ 3, OUTTGL
+  bx    lr                  @ 5
+  .ltorg
+  .size blink, . - blink
+
+@ 4 + 5 + 2 + 7 + 133 + 8 = 159 cycles
+FUNCTION filter
+  push  {r7, lr}            @ 4
+  ldr   r0, =samples        @ 5
+  movs  r1, #8              @ 2
+  bl    sum                 @ 7 + 133
+  pop   {r7, pc}            @ 8
+  .ltorg
+  .size filter, . - filter
+
+@ 2 + 5 + 8 * 14 + 7 + 2 + 5 = 133 cycles. Entered at the test, so 8 times
+@ round and the test once more
+FUNCTION sum
+  movs  r2, #0              @ 2
+  b     2f                  @ 5
+1:
+  LOOP_BOUND 8
+  ldm   r0!, {r3}           @ 3
+  adds  r2, r2, r3          @ 2
+  subs  r1, #1              @ 2
+2:
+  cmp   r1, #0              @ 2
+  bne   1b                  @ 5
+  movs  r0, r2              @ 2
+  bx    lr                  @ 5
+  .size sum, . - sum
+
+@ 7 cycles
+FUNCTION filter_ok
+  movs  r0, #1              @ 2
+  bx    lr                  @ 5
+  .size filter_ok, . - filter_ok
+
+@ 15 cycles
+FUNCTION filter_backup
+  ldr   r3, =samples        @ 5
+  movs  r2, #0              @ 2
+  str   r2, [r3]            @ 3
+  bx    lr                  @ 5
+  .ltorg
+  .size filter_backup, . - filter_backup
+
+@ Task WCETs: the _task_entry() path plus PendSV (218) and TC4 (62), each
+@ with 34 cycles of exception entry and return, so 348 on top
+@   blink          62 + 15 + 27 + 348 = 437
+@   filter         240 + 348 = 588
+@   filter_backup  34 + 15 + 27 + 348 = 424
+
+  .global task_table
+  .type task_table, %object
+  .p2align 2
+task_table:
+  .word blink_name, blink, 0, 0, blink_stack
+  .short 256, 0
+  .word 0, 0, 0
+  .word filter_name, filter, filter_ok, filter_backup, filter_stack
+  .short 256, 0
+  .word 0, 0, 0
+  .size task_table, . - task_table
+
+  .global task_count
+  .type task_count, %object
+task_count:
+  .byte 2
+  .size task_count, . - task_count
+
+blink_name:
+  .asciz "blink"
+filter_name:
+  .asciz "filter"
+
+  .p2align 2
+  .global _erom
+_erom:
+
+  .global ROM_LENGTH, RAM_LENGTH
+  .equ ROM_LENGTH, 0x8000
+  .equ RAM_LENGTH, 0x1000
+
+  .bss
+  .p2align 3
+  .global _sram
+_sram:
+
+  .type tasks, %object
+tasks:
+  .space 32
+  .size tasks, . - tasks
+
+  .type budget, %object
+budget:
+  .space 4
+  .size budget, . - budget
+
+  .type samples, %object
+samples:
+  .space 32
+  .size samples, . - samples
+
+  .p2align 3
+  .type blink_stack, %object
+blink_stack:
+  .space 256
+  .size blink_stack, . - blink_stack
+
+  .type filter_stack, %object
+filter_stack:
+  .space 256
+  .size filter_stack, . - filter_stack
+
+  .global _sstack, _estack, _eram
+_sstack:
+  .space 512
+_estack:
+_eram:
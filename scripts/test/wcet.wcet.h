@@ -0,0 +1,10 @@
+// Generated by scripts/stack_analyze.py from wcet.elf, do not edit.
+// Worst case execution times in CPU cycles, for TaskConf_t.wcet and backup_wcet.
+#ifndef _WCET_H
+#define _WCET_H
+
+#define WCET_blink (437u)
+#define WCET_filter (588u)
+#define WCET_filter_backup (424u)
+
+#endif
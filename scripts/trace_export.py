@@ -0,0 +1,177 @@
+import re
+import os
+import sys
+import json
+import array
+import struct
+import subprocess
+
+"""
+Decode a kernel trace dump (src/kernel/trace.h) into Chrome trace JSON,
+for chrome://tracing or ui.perfetto.dev.
+Pass arguments: python3 trace_export.py program.elf trace.bin [trace.json]
+
+Dump trace.bin from GDB with the firmware built with KERNEL_TRACE=1:
+  (gdb) dump binary value trace.bin kernel_trace
+
+Tasks are named after their job (or coroutine) function and interrupts
+after their handler, both looked up in the ELF with nm the same way
+stack_analyze.py does. The buffer size comes from the size of the
+kernel_trace symbol, so it doesn't need to be passed in.
+
+Each task gets a track with a slice per time it held the CPU, plus
+markers for releases, preemptions and jobs finishing. Interrupts and
+application locks get tracks of their own.
+"""
+
+objcopy = os.path.join('arm-none-eabi-objcopy')
+nm = os.path.join('arm-none-eabi-nm')
+
+# TraceType_t
+DISPATCH, PREEMPT, RELEASE, BLOCK, ISR_ENTER, ISR_EXIT, LOCK, UNLOCK = range(8)
+TRACE_IDLE = 0xFF
+
+TID_IDLE = 255
+TID_ISR = 1000
+TID_LOCK = 2000
+
+
+"""
+nm gives the symbol table, start addr, size, type and name:
+00001c18 00000060 T TC2_Handler
+"""
+def load_symbols(elf_file):
+  out = subprocess.check_output([nm, '-n', '--print-size', elf_file], encoding='ascii')
+  functions = {}
+  objects = {}
+  for m in re.findall(r'(?m)^([0-9a-f]+) ([0-9a-f]+) (.) (.*)$', out):
+    addr, size, kind, name = int(m[0], 16), int(m[1], 16), m[2], m[3]
+    if kind in 'tTwW':
+      functions.setdefault(addr & 0xFFFE, name)
+    objects[name] = (addr, size)
+  return functions, objects
+
+
+"""
+Exception table, same as stack_analyze.py: the start of .vectors, or of
+the whole image if there's no such section.
+"""
+def load_vectors(elf_file, objects):
+  bin_file = elf_file.replace('.elf', '.vectors.bin')
+  subprocess.check_output([objcopy, '-O', 'binary', '--only-section=.vectors', elf_file, bin_file])
+  with open(bin_file, 'br') as f:
+    out = f.read()
+  os.remove(bin_file)
+
+  if len(out) == 0:
+    out = subprocess.check_output([objcopy, '-O', 'binary', elf_file, '-'])
+  if 'exception_table' in objects:
+    out = out[:objects['exception_table'][1]]
+  out = out[:len(out) // 4 * 4]
+  return [x & 0xFFFFFFFE for x in array.array('I', out)]
+
+
+"""
+KERNEL_CPU_HZ, the first of the words kernel.c leaves in .kernel_clock.
+The section isn't loaded, so objcopy -O binary leaves it out, and it's
+dumped on its own. None if the ELF has no such section.
+"""
+def load_cpu_hz(elf_file):
+  bin_file = elf_file.replace('.elf', '.clock.bin')
+  tmp_file = elf_file.replace('.elf', '.clock.elf')
+  try:
+    subprocess.check_output([objcopy, f'--dump-section=.kernel_clock={bin_file}', elf_file, tmp_file], stderr=subprocess.STDOUT)
+    with open(bin_file, 'br') as f:
+      return struct.unpack_from('<I', f.read(4))[0]
+  except (subprocess.CalledProcessError, OSError, struct.error):
+    return None
+  finally:
+    for path in (bin_file, tmp_file):
+      if os.path.exists(path):
+        os.remove(path)
+
+
+def main():
+  elf_file, trace_file = sys.argv[1], sys.argv[2]
+  functions, objects = load_symbols(elf_file)
+  vectors = load_vectors(elf_file, objects)
+  cpu_hz = load_cpu_hz(elf_file)
+  if not cpu_hz:
+    print('** Error: No .kernel_clock section in the ELF, is it the kernel? **')
+    exit(1)
+
+  if 'kernel_trace' not in objects:
+    print('** Error: No kernel_trace in the ELF, was it built with KERNEL_TRACE=1? **')
+    exit(1)
+  size = (objects['kernel_trace'][1] - 4) // 8
+
+  with open(trace_file, 'rb') as f:
+    raw = f.read()
+  (head,) = struct.unpack_from('<I', raw, 0)
+  slots = [struct.unpack_from('<II', raw, 4 + 8 * i) for i in range(size)]
+
+  # Oldest first
+  if head > size:
+    start = head % size
+    events = slots[start:] + slots[:start]
+  else:
+    events = slots[:head]
+
+  def task_name(tid, addr):
+    if tid == TRACE_IDLE: return 'idle'
+    return functions.get(addr & 0xFFFE, f'task{tid}')
+
+  def isr_name(n):
+    if n < len(vectors) and (vectors[n] & 0xFFFE) in functions:
+      return functions[vectors[n] & 0xFFFE]
+    return f'exception {n}'
+
+  out = []
+  names = {}
+  running = None # (tid, start)
+  now = 0
+  last = events[0][0] if events else 0
+
+  for (time, info) in events:
+    now += (time - last) & 0xFFFFFFFF # Cycle counter wraps every 89 s
+    last = time
+    ts = now * 1000000 / cpu_hz
+
+    kind, ident, addr = info & 0xFF, (info >> 8) & 0xFF, info >> 16
+    if kind in (DISPATCH, PREEMPT, RELEASE, BLOCK):
+      tid = TID_IDLE if ident == TRACE_IDLE else ident
+      names[tid] = task_name(ident, addr)
+
+    if kind == DISPATCH:
+      if running:
+        out.append({ 'name': names[running[0]], 'ph': 'X', 'pid': 0, 'tid': running[0], 'ts': running[1], 'dur': ts - running[1] })
+      running = (tid, ts)
+    elif kind in (PREEMPT, RELEASE, BLOCK):
+      label = { PREEMPT: 'preempt', RELEASE: 'release', BLOCK: 'done' }[kind]
+      out.append({ 'name': label, 'ph': 'i', 's': 't', 'pid': 0, 'tid': tid, 'ts': ts })
+    elif kind in (ISR_ENTER, ISR_EXIT):
+      names[TID_ISR + ident] = isr_name(ident)
+      out.append({ 'name': names[TID_ISR + ident], 'ph': 'B' if kind == ISR_ENTER else 'E', 'pid': 0, 'tid': TID_ISR + ident, 'ts': ts })
+    elif kind in (LOCK, UNLOCK):
+      names[TID_LOCK + ident] = f'lock {ident}'
+      out.append({ 'name': f'lock {ident}', 'ph': 'B' if kind == LOCK else 'E', 'pid': 0, 'tid': TID_LOCK + ident, 'ts': ts })
+
+  # Whatever is running at the end of the dump
+  if running:
+    out.append({ 'name': names[running[0]], 'ph': 'X', 'pid': 0, 'tid': running[0], 'ts': running[1], 'dur': now * 1000000 / cpu_hz - running[1] })
+
+  for tid, name in names.items():
+    out.append({ 'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': tid, 'args': { 'name': name } })
+    out.append({ 'name': 'thread_sort_index', 'ph': 'M', 'pid': 0, 'tid': tid, 'args': { 'sort_index': tid } })
+
+  result = json.dumps({ 'traceEvents': out, 'displayTimeUnit': 'ns' }, indent=1)
+  if len(sys.argv) > 3:
+    with open(sys.argv[3], 'w') as f:
+      f.write(result)
+  else:
+    print(result)
+
+  print(f'{len(events)} events ({head} recorded, {size} slots), {now * 1000000 / cpu_hz:.1f} us', file=sys.stderr)
+
+
+main()
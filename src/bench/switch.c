@@ -0,0 +1,175 @@
+#include "../common/common.h"
+#include "../conf/conf.h"
+#include "../kernel/kernel.h"
+#include "../kernel/port.h"
+
+#include <samd21.h>
+
+/*
+    Context switch microbenchmark. `make bench-switch` builds this in
+    place of main.c. Cycles are measured with SysTick->VAL, which counts
+    down at the CPU clock. Each figure is the best of all runs so far, so
+    the odd interrupt landing in a measurement doesn't skew it.
+
+    The bench is linked with --wrap=kernel_switch, so PendSV calls it
+    through a wrapper that times the C side of each switch separately.
+    Whatever is left is the exception entry/exit and pendsv.s itself.
+
+    co measures the same thing between two coroutine tasks, which are
+    dispatched on the idle stack without saving or restoring registers.
+    RAM per task is the TCB plus the stack, and coroutines have no stack.
+
+    Flash it, let it run for a bit and read the results in GDB:
+      (gdb) print bench_switch
+    Then check them against the model:
+      python3 scripts/switch_cycles.py build/bench_switch.elf <self> <self_kernel>
+*/
+
+typedef struct {
+  uint32_t overhead;    // Two back to back SysTick->VAL reads
+  uint32_t self;        // port_yield() with nothing else to run. PendSV without the register save
+  uint32_t self_kernel; // Part of self spent in kernel_switch()
+  uint32_t full;        // kernel_release() of a higher priority task until its job starts
+  uint32_t full_kernel; // Part of full spent in kernel_switch()
+  uint32_t co;          // Coroutine releasing a higher priority coroutine until its step starts.
+                        // Includes the rest of the releasing step and its _job_done()
+  uint32_t ram_thread;  // Bytes per thread task
+  uint32_t ram_coroutine;
+  uint32_t runs;
+} BenchSwitch_t;
+
+volatile BenchSwitch_t bench_switch = { UINT32_MAX, UINT32_MAX, 0, UINT32_MAX, 0, UINT32_MAX, 0, 0, 0 };
+
+static volatile uint32_t full_start;
+static volatile uint32_t co_start;
+static volatile uint32_t switch_kernel; // Last kernel_switch() call
+
+// SysTick->VAL counts down and reloads every tick
+static uint32_t _elapsed(uint32_t start, uint32_t end) {
+  return start >= end ? start - end : start + SysTick->LOAD + 1 - end;
+}
+
+uint32_t * __real_kernel_switch(uint32_t * sp);
+
+uint32_t * __wrap_kernel_switch(uint32_t * sp) {
+  uint32_t start  = SysTick->VAL;
+  uint32_t * next = __real_kernel_switch(sp);
+  switch_kernel   = _elapsed(start, SysTick->VAL) - bench_switch.overhead;
+  return next;
+}
+
+/************************************
+ * TASKS
+ ************************************/
+
+TASK_STACK(lo_stack, 256);
+TASK_STACK(hi_stack, 256);
+
+static void hi(void * arg) {
+  uint32_t end = SysTick->VAL;
+  UNUSED(arg);
+
+  uint32_t full = _elapsed(full_start, end) - bench_switch.overhead;
+  if (full < bench_switch.full) {
+    bench_switch.full        = full;
+    bench_switch.full_kernel = switch_kernel;
+  }
+}
+
+static void lo(void * arg) {
+  UNUSED(arg);
+
+  uint32_t start        = SysTick->VAL;
+  uint32_t end          = SysTick->VAL;
+  uint32_t base         = _elapsed(start, end);
+  bench_switch.overhead = MIN(bench_switch.overhead, base);
+
+  start = SysTick->VAL;
+  port_yield();
+  __ISB();
+  end           = SysTick->VAL;
+  uint32_t self = _elapsed(start, end) - base;
+  if (self < bench_switch.self) {
+    bench_switch.self        = self;
+    bench_switch.self_kernel = switch_kernel;
+  }
+
+  full_start = SysTick->VAL;
+  kernel_release(kernel_task(1)); // Preempts right away, hi() takes the end time
+
+  bench_switch.runs++;
+}
+
+// Released by co_lo, takes the end time
+static void co_hi(Pt_t * pt, void * arg) {
+  uint32_t end = SysTick->VAL;
+  UNUSED(pt);
+  UNUSED(arg);
+
+  bench_switch.co = MIN(bench_switch.co, _elapsed(co_start, end) - bench_switch.overhead);
+}
+
+static void co_lo(Pt_t * pt, void * arg) {
+  UNUSED(arg);
+
+  PT_BEGIN(pt);
+  while (1) {
+    kernel_release(kernel_task(3)); // Waits for this step to end
+    co_start = SysTick->VAL;
+    PT_YIELD(pt);
+  }
+  PT_END(pt);
+}
+
+const TaskConf_t task_table[] = {
+  {
+    .name       = "lo",
+    .job        = lo,
+    .stack      = lo_stack,
+    .stack_size = sizeof(lo_stack),
+    .period     = 10,
+    .wcet       = KERNEL_CYCLES_PER_TICK,
+    .policy     = DEADLINE_CONTINUE,
+  },
+  {
+    .name       = "hi",
+    .job        = hi,
+    .stack      = hi_stack,
+    .stack_size = sizeof(hi_stack),
+    .deadline   = 1, // Aperiodic, released by lo
+    .wcet       = KERNEL_CYCLES_PER_TICK / 10,
+    .policy     = DEADLINE_CONTINUE,
+  },
+  {
+    .name      = "co_lo",
+    .coroutine = co_lo,
+    .period    = 10,
+    .offset    = 5, // Clear of lo
+    .wcet      = KERNEL_CYCLES_PER_TICK / 10,
+    .policy    = DEADLINE_CONTINUE,
+  },
+  {
+    .name      = "co_hi",
+    .coroutine = co_hi,
+    .deadline  = 1, // Aperiodic, released by co_lo
+    .wcet      = KERNEL_CYCLES_PER_TICK / 10,
+    .policy    = DEADLINE_CONTINUE,
+  },
+};
+const uint8_t task_count = ARRAY_SIZE(task_table);
+
+/************************************
+ * MAIN
+ ************************************/
+
+void main() {
+  conf();
+
+  bench_switch.ram_thread    = sizeof(Task_t) + sizeof(hi_stack);
+  bench_switch.ram_coroutine = sizeof(Task_t);
+
+  if (!kernel_init()) {
+    while (1) {} // Task set failed admission control
+  }
+  kernel_start();
+}
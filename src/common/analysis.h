@@ -0,0 +1,85 @@
+#ifndef _ANALYSIS_H
+#define _ANALYSIS_H
+
+/*
+    Annotations for scripts/stack_analyze.py. They record addresses in
+    sections that aren't loaded, so they cost no flash, RAM or cycles.
+*/
+
+#if defined(__arm__)
+
+/**
+ * Bound the loop this sits in for WCET analysis: its body runs at most n
+ * times each time the loop is entered. Put it inside the body, any
+ * unbounded loop makes the function's WCET unbounded.
+ *
+ *   for (uint8_t i = 0; i < tasks_num; i++) {
+ *     LOOP_BOUND(KERNEL_MAX_TASKS);
+ *     ...
+ *   }
+ *
+ * Emits (address, n) into .loop_bounds. The analyser picks the innermost
+ * loop around the address, so it survives inlining and unrolling.
+ */
+#define LOOP_BOUND(n)                                              \
+  __asm__ volatile(".pushsection .loop_bounds, \"\", %%progbits\n" \
+                   ".word 1f, %c0\n"                               \
+                   ".popsection\n"                                 \
+                   "1:" ::"i"(n))
+
+/**
+ * Name a target of the next indirect call (blx) after this, for stack and
+ * WCET analysis. Use one per possible target. Calls through function
+ * pointers are otherwise left out, with a warning.
+ *
+ *   INDIRECT_CALL(on_rx);
+ *   INDIRECT_CALL(on_tx);
+ *   handlers[event](arg);
+ *
+ * Emits (address, fn) into .indirect_calls.
+ */
+#define INDIRECT_CALL(fn)                                             \
+  __asm__ volatile(".pushsection .indirect_calls, \"\", %%progbits\n" \
+                   ".word 1f, %c0\n"                                  \
+                   ".popsection\n"                                    \
+                   "1:" ::"i"(fn))
+
+/**
+ * End the function here for WCET analysis: paths that reach this point stop,
+ * and whatever comes after it only counts if there's another way in. For code
+ * that isn't charged to the caller, like the rest of _task_entry() once the
+ * job is done.
+ *
+ * Emits (address, 0) into .wcet_ends.
+ */
+#define WCET_END()                                                \
+  __asm__ volatile(".pushsection .wcet_ends, \"\", %%progbits\n" \
+                   ".word 1f, 0\n"                                \
+                   ".popsection\n"                                \
+                   "1:" ::)
+
+/**
+ * Record the NVIC priority an interrupt is set to, for the interrupt nesting
+ * in the stack analysis. Put it next to where the priority is set:
+ *
+ *   NVIC_SetPriority(TC4_IRQn, 1);
+ *   IRQ_PRIORITY(TC4_IRQn, 1);
+ *
+ * Interrupts without one count as the reset priority, 0 (the highest).
+ * Emits (exception number, priority) into .irq_priorities.
+ */
+#define IRQ_PRIORITY(irq, priority)                                   \
+  __asm__ volatile(".pushsection .irq_priorities, \"\", %%progbits\n" \
+                   ".word %c0, %c1\n"                                 \
+                   ".popsection" ::"i"((irq) + 16), "i"(priority))
+
+#else
+
+#define LOOP_BOUND(n) // Host builds (make sim) aren't analysed
+#define INDIRECT_CALL(fn)
+#define WCET_END()
+#define IRQ_PRIORITY(irq, priority)
+
+#endif
+
+#endif
@@ -21,9 +21,15 @@
  * GCC needs the .syntax tags before and after this snippet. It struggles
  * with Thumb1 vs Thumb2 syntax, which causes problems with "subs Rd, Rn, #imm".
  * Clang handles it fine. Sigh.
+ *
+ * The CPU frequency is whatever the caller says. clock_busy_wait_us() and
+ * clock_busy_wait_ms() in conf/clocks.h take it from the clock registry.
  */
-static inline void busy_wait_ms(const unsigned long cpufreq_khz, const unsigned long ms) {
-  unsigned long clocks = (cpufreq_khz * ms) / 4;
+static inline void busy_wait_cycles(const unsigned long cycles) {
+  unsigned long clocks = cycles / 4;
+  if (clocks == 0) {
+    return; // SUBS would wrap around
+  }
   __asm__ volatile(
     ".syntax unified\n"
     "label%=: SUBS %0, %0, #1\n"
@@ -34,6 +40,10 @@ static inline void busy_wait_ms(const unsigned long cpufreq_khz, const unsigned
     : "0"(clocks));
 }
 
+static inline void busy_wait_ms(const unsigned long cpufreq_khz, const unsigned long ms) {
+  busy_wait_cycles(cpufreq_khz * ms);
+}
+
 static inline void busy_wait_us(const unsigned long cpufreq_mhz, const unsigned long us)
   __attribute__((alias("busy_wait_ms")));
 
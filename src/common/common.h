@@ -1,8 +1,10 @@
 #ifndef _COMMON_H
 #define _COMMON_H
 
+#include "analysis.h"
 #include "busy_wait.h"
 #include "calibration.h"
+#include "gpio.h"
 #include "limits.h"
 #include "pinout.h"
 
@@ -15,6 +17,12 @@
 #define __packed __attribute__((packed))
 #endif
 
+// Left as it was at reset rather than zeroed, for big buffers that are
+// written before they're read (stacks, DMA buffers). See .noinit in the linker script
+#ifndef __noinit
+#define __noinit __attribute__((section(".noinit")))
+#endif
+
 #define PORTA (&PORT->Group[0])
 #define PORTB (&PORT->Group[1])
 
@@ -54,4 +62,7 @@
 #define ON_HYSTERESIS(val, state_true, on_thresh, off_thresh) \
   ((val > on_thresh && !state_true) || ((val > off_thresh) && state_true))
 
+// CPU cycles from reset to main(), counted on SysTick by Reset_Handler
+extern uint32_t boot_cycles;
+
 #endif
\ No newline at end of file
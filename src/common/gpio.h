@@ -0,0 +1,52 @@
+#ifndef _GPIO_H
+#define _GPIO_H
+
+#include <samd21.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * GPIO through the IOBUS port alias (PORT_IOBUS, 0x60000000). The
+ * Cortex-M0+ reaches it straight from the core, so a set, clear or
+ * toggle is one single-cycle store. PORT on the APB takes several
+ * cycles more per access, going through the AHB-APB bridge.
+ *
+ * Pins are pin numbers, PIN_PAxx/PIN_PBxx from the device header or
+ * the names for them in pinout.h. Pass a constant and each call inlines
+ * to a store of a constant mask to a constant address. They don't
+ * configure the pin, set it to PINFUNC_OUTPUT (or an input) in pinout.h.
+ */
+
+#define GPIO_GROUP(pin) (&PORT_IOBUS->Group[(pin) / 32])
+#define GPIO_MASK(pin)  (1ul << ((pin) % 32))
+
+static inline __attribute__((always_inline)) void gpio_set(const uint8_t pin) {
+  GPIO_GROUP(pin)->OUTSET.reg = GPIO_MASK(pin);
+}
+
+static inline __attribute__((always_inline)) void gpio_clear(const uint8_t pin) {
+  GPIO_GROUP(pin)->OUTCLR.reg = GPIO_MASK(pin);
+}
+
+static inline __attribute__((always_inline)) void gpio_toggle(const uint8_t pin) {
+  GPIO_GROUP(pin)->OUTTGL.reg = GPIO_MASK(pin);
+}
+
+static inline __attribute__((always_inline)) void gpio_write(const uint8_t pin, const bool high) {
+  if (high) {
+    gpio_set(pin);
+  } else {
+    gpio_clear(pin);
+  }
+}
+
+/**
+ * @brief Read an input. The IOBUS doesn't sample IN on demand the way an
+ * APB read does, so the pin needs continuous sampling turned on first
+ * (PORT->Group[n].CTRL.reg |= GPIO_MASK(pin)), or this reads stale.
+ */
+static inline __attribute__((always_inline)) bool gpio_read(const uint8_t pin) {
+  return (GPIO_GROUP(pin)->IN.reg & GPIO_MASK(pin)) != 0;
+}
+
+#endif
@@ -1,94 +1,78 @@
 #include "../common/common.h"
+#include "clocks.h"
 #include "conf.h"
 
 #include <samd21.h>
 
-// Maximum Clock Frequencies Table: Datasheet 37.6
+#define GCLK_GEN(n)                                                                                          \
+  {                                                                                                          \
+    .gendiv  = GCLK_GENDIV_DIV(GCLK##n##_DIV) | GCLK_GENDIV_ID(n),                                           \
+    .genctrl = (GCLK##n##_DIVSEL ? GCLK_GENCTRL_DIVSEL : 0) | GCLK_GENCTRL_GENEN | GCLK_GENCTRL_SRC(GCLK##n##_SOURCE) | \
+               GCLK_GENCTRL_ID(n),                                                                           \
+    .hz      = GCLK_HZ(n),                                                                                   \
+  }
 
 typedef struct {
-  uint8_t source;
-  uint8_t divsel; // False: GCLK = GCLK / div. True: GCLK = GCLK / 2^(div + 1)
-  uint16_t div;   // GCLK0, 3-8 have 8 bits. GCLK1 has 16 bits. GCLK2 has 5 bits.
+  uint32_t gendiv;
+  uint32_t genctrl;
+  uint32_t hz; // For the clock registry
 } ClockConf_t;
 
-// Configure clock generators. Connect clock source (i.e. FLL, 32k oscillator) and divide down
-static ClockConf_t clocks[GCLK_GEN_NUM] = {
-  {
-    .source = GCLK_GENCTRL_SRC_DFLL48M_Val, // 48 MHz
-    .divsel = 0,
-    .div    = 1,
-  },
-  {
-    .source = GCLK_GENCTRL_SRC_OSC32K_Val, // 32.768 kHz
-    .divsel = 0,
-    .div    = 1,
-  },
-  { 0 },
-  { 0 },
-  { 0 },
-  { 0 },
-  { 0 },
-  { 0 },
-  {
-    .source = GCLK_GENCTRL_SRC_DPLL96M_Val, // 96 MHz
-    .divsel = 0,
-    .div    = 1,
-  },
+static const ClockConf_t clocks[] = {
+  GCLK_GEN(0),
+  GCLK_GEN(1),
+  GCLK_GEN(8),
 };
 
-// Select which clock generator to connect to each peripheral.
-#define PERIPHERALS_DISABLE (0xFF)
-static uint8_t peripherals[GCLK_NUM] = {
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) DFLL48 */
-  GCLK_CLKCTRL_GEN_GCLK1_Val, /**< \brief (GCLK_CLKCTRL) FDPLL */
-  GCLK_CLKCTRL_GEN_GCLK1_Val, /**< \brief (GCLK_CLKCTRL) FDPLL32K */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) WDT */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) RTC */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EIC */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) USB */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_0 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_1 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_2 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_3 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_4 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_5 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_6 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_7 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_8 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_9 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_10 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) EVSYS_11 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) SERCOMX_SLOW */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) SERCOM0_CORE */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) SERCOM1_CORE */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) SERCOM2_CORE */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) SERCOM3_CORE */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) SERCOM4_CORE */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) SERCOM5_CORE */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) TCC0_TCC1 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) TCC2_TC3 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) TC4_TC5 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) TC6_TC7 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) ADC */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) AC_DIG */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) AC_ANA */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) DAC */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) PTC */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) I2S_0 */
-  PERIPHERALS_DISABLE,        /**< \brief (GCLK_CLKCTRL) I2S_1 */
+// Connect a peripheral channel (GCLK_CLKCTRL_ID_*_Val) to a clock generator
+#define GCLK_CHANNEL(id, n) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN(n) | GCLK_CLKCTRL_ID(id))
+
+static const uint16_t peripherals[] = {
+  GCLK_CHANNEL(GCLK_CLKCTRL_ID_FDPLL_Val, 1),
+  GCLK_CHANNEL(GCLK_CLKCTRL_ID_FDPLL32K_Val, 1),
+  GCLK_CHANNEL(GCLK_CLKCTRL_ID_TC4_TC5_Val, 0),
 };
 
+_Static_assert(GCLK_HZ(0) <= GCLK_CPU_MAX_HZ, "GCLK0 (CPU) over 48 MHz");
+_Static_assert(GCLK_HZ(1) <= GCLK_GEN_MAX_HZ, "GCLK1 over the generator limit");
+_Static_assert(GCLK_HZ(8) <= GCLK_GEN_MAX_HZ, "GCLK8 over the generator limit");
+_Static_assert(GCLK_HZ(1) <= GCLK_DPLL_MAX_HZ, "FDPLL reference (GCLK1) over 2 MHz");
+_Static_assert(GCLK_HZ(1) <= GCLK_DPLL_32K_MAX_HZ, "FDPLL32K (GCLK1) over 100 kHz");
+_Static_assert(GCLK_HZ(0) <= GCLK_PERIPHERAL_MAX_HZ, "TC4_TC5 (GCLK0) over 48 MHz");
+_Static_assert(GCLK1_DIV <= 0xFFFF && GCLK0_DIV <= 0xFF && GCLK8_DIV <= 0xFF, "Divider too wide for its generator");
+
 // Connect APB clocks to each peripheral (everything except APBC is
 // enabled by default)
 // clang-format off
-#define PERIPHERAL_APB (PM_APBCMASK_ADC)
+#define PERIPHERAL_APB (PM_APBCMASK_ADC | PM_APBCMASK_TC4 | PM_APBCMASK_TC5)
 // clang-format on
 
+// Out of reset the CPU runs on OSC8M divided by 8, and nothing else is on
+ClockRate_t clock_gens[GCLK_GEN_NUM] = {
+  [0] = CLOCK_RATE(1000000),
+};
+uint8_t clock_channels[GCLK_NUM] = {
+  [0 ... GCLK_NUM - 1] = CLOCK_NONE,
+};
+const ClockRate_t clock_none = {0};
+
+void clock_set_rate(uint8_t gen, uint32_t hz) {
+  ClockRate_t * clock = &clock_gens[gen];
+  clock->hz            = hz;
+  clock->cycles_per_us = ((uint64_t) hz << 16) / 1000000;
+  clock->us_per_cycle  = hz ? (((uint64_t) 1000000 << 24) + hz - 1) / hz : 0;
+}
+
+void clock_connect(uint8_t id, uint8_t gen) {
+  GCLK->CLKCTRL.reg  = GCLK_CHANNEL(id, gen);
+  clock_channels[id] = gen;
+}
+
 void _conf_clocks() {
   // Start up the DFLL
   SYSCTRL->DFLLCTRL.reg  = SYSCTRL_DFLLCTRL_ENABLE; // Handle Errata 1.2.1
   SYSCTRL->DFLLVAL.reg   = SYSCTRL_DFLLVAL_COARSE(FUSES->dfll48m_coarse_cal) | SYSCTRL_DFLLVAL_FINE(FUSES->dfll48m_fine_cal);
-  NVMCTRL->CTRLB.bit.RWS = NVMCTRL_CTRLB_RWS_DUAL; // Increase read/wait states so flash can keep up at 48MHz
+  NVMCTRL->CTRLB.bit.RWS = NVM_RWS(GCLK_HZ(0)); // Increase read/wait states so flash can keep up at 48MHz
   while (!(SYSCTRL->PCLKSR.bit.DFLLRDY)) {}
 
   // Start up OSC32k
@@ -96,18 +80,16 @@ void _conf_clocks() {
   while (!(SYSCTRL->PCLKSR.bit.OSC32KRDY)) {}
 
   // Configure clock generators
-  for (int i = 0; i < GCLK_GEN_NUM; i++) {
-    if (clocks[i].source) { // XOSC is source 0, we're never using a crystal
-      GCLK->GENDIV.reg  = GCLK_GENDIV_DIV(clocks[i].div) | GCLK_GENDIV_ID(i);
-      GCLK->GENCTRL.reg = (clocks[i].divsel ? GCLK_GENCTRL_DIVSEL : 0) | (GCLK_GENCTRL_GENEN) | (GCLK_GENCTRL_SRC(clocks[i].source)) | (GCLK_GENCTRL_ID(i));
-    }
+  for (uint8_t i = 0; i < ARRAY_SIZE(clocks); i++) {
+    GCLK->GENDIV.reg  = clocks[i].gendiv;
+    GCLK->GENCTRL.reg = clocks[i].genctrl;
+    clock_set_rate(clocks[i].gendiv & GCLK_GENDIV_ID_Msk, clocks[i].hz);
   }
 
   // Connect peripherals to clock generators
-  for (int i = 0; i < GCLK_NUM; i++) {
-    if (peripherals[i] != PERIPHERALS_DISABLE) {
-      GCLK->CLKCTRL.reg = (GCLK_CLKCTRL_CLKEN) | (GCLK_CLKCTRL_GEN(peripherals[i])) | (GCLK_CLKCTRL_ID(i));
-    }
+  for (uint8_t i = 0; i < ARRAY_SIZE(peripherals); i++) {
+    GCLK->CLKCTRL.reg = peripherals[i];
+    clock_channels[peripherals[i] & GCLK_CLKCTRL_ID_Msk] = (peripherals[i] & GCLK_CLKCTRL_GEN_Msk) >> GCLK_CLKCTRL_GEN_Pos;
   }
 
   // Enable AHB/APB clocks for peripherals
@@ -0,0 +1,137 @@
+#ifndef _CLOCKS_H
+#define _CLOCKS_H
+
+#include "../common/common.h"
+
+#include <samd21.h>
+
+// Maximum Clock Frequencies Table: Datasheet 37.6
+#define GCLK_GEN_MAX_HZ         (96000000) // Any generator, GCLK_MAIN
+#define GCLK_CPU_MAX_HZ         (48000000) // GCLK0, the CPU runs on it undivided
+#define GCLK_PERIPHERAL_MAX_HZ  (48000000) // Peripheral channels not listed below
+#define GCLK_DFLL48M_REF_MAX_HZ (33000)
+#define GCLK_DPLL_MAX_HZ        (2000000)
+#define GCLK_DPLL_32K_MAX_HZ    (100000)
+
+/*
+    Clock generators. Each one is a source, its frequency, and a divider:
+    divsel 0 divides by div (0 and 1 both mean undivided), divsel 1 by
+    2^(div + 1). GCLK0, 3-8 have 8 bit dividers, GCLK1 has 16 bits, GCLK2 5 bits.
+    GCLK_GEN() in clocks.c turns them into the GENDIV and GENCTRL values
+    _conf_clocks() writes, GCLK_HZ() into the frequency they run at.
+*/
+#define GCLK0_SOURCE    GCLK_GENCTRL_SRC_DFLL48M_Val
+#define GCLK0_SOURCE_HZ (48000000)
+#define GCLK0_DIVSEL    (0)
+#define GCLK0_DIV       (1)
+
+#define GCLK1_SOURCE    GCLK_GENCTRL_SRC_OSC32K_Val
+#define GCLK1_SOURCE_HZ (32768)
+#define GCLK1_DIVSEL    (0)
+#define GCLK1_DIV       (1)
+
+#define GCLK8_SOURCE    GCLK_GENCTRL_SRC_DPLL96M_Val
+#define GCLK8_SOURCE_HZ (96000000)
+#define GCLK8_DIVSEL    (0)
+#define GCLK8_DIV       (1)
+
+// Flash wait states the CPU runs with at hz: none up to 24 MHz, two above
+// that. With VDD 2.7 V and up the datasheet only asks for one above 24 MHz,
+// the second is the margin _conf_clocks() has always run 48 MHz with, and
+// what the cycle models in stack_analyze.py and switch_cycles.py assume.
+#define NVM_RWS(hz) ((hz) <= 24000000 ? 0 : NVMCTRL_CTRLB_RWS_DUAL_Val)
+
+#define GCLK_HZ(n)                                                        \
+  (GCLK##n##_DIVSEL ? GCLK##n##_SOURCE_HZ >> (GCLK##n##_DIV + 1)          \
+                    : GCLK##n##_SOURCE_HZ / (GCLK##n##_DIV ? GCLK##n##_DIV : 1))
+
+/*
+    Clock registry. _conf_clocks() records the frequency of each clock
+    generator as it sets them up, and which generator each peripheral
+    channel (GCLK_CLKCTRL_ID_*) is connected to. Anything that turns time
+    into cycles asks here instead of assuming 48 MHz.
+
+    The M0+ has no divide instruction, a division is a libgcc call of
+    tens of cycles. So each generator keeps reciprocals of its frequency,
+    worked out once when it changes, and the conversions below are a
+    multiply and a shift.
+*/
+
+typedef struct {
+  uint32_t hz;
+  uint32_t cycles_per_us; // 16.16 fixed point
+  uint32_t us_per_cycle;  // 8.24 fixed point, rounded up, so down to 3.9 kHz
+} ClockRate_t;
+
+#define CLOCK_RATE(_hz)                                                                     \
+  {                                                                                         \
+    .hz            = (_hz),                                                                 \
+    .cycles_per_us = (uint32_t) (((uint64_t) (_hz) << 16) / 1000000),                       \
+    .us_per_cycle  = (uint32_t) ((((uint64_t) 1000000 << 24) + (_hz) - 1) / (_hz)),         \
+  }
+
+#define CLOCK_NONE (0xFF) // Channel not connected
+
+extern ClockRate_t clock_gens[GCLK_GEN_NUM];
+extern uint8_t clock_channels[GCLK_NUM]; // Generator of each channel, or CLOCK_NONE
+extern const ClockRate_t clock_none;     // All zero, what a channel runs at until it's connected
+
+/**
+ * @brief Record a generator's new frequency, after switching it. The one
+ * place that divides.
+ */
+void clock_set_rate(uint8_t gen, uint32_t hz);
+
+// Same, from a CLOCK_RATE() worked out at compile time, for switches that
+// can't afford the divisions (port_clock_set())
+static inline void clock_set(uint8_t gen, const ClockRate_t * rate) {
+  clock_gens[gen] = *rate;
+}
+
+/**
+ * @brief Connect a peripheral channel to a generator and record it. Do
+ * this before asking clock_channel() what the channel runs at.
+ *
+ * @param id GCLK_CLKCTRL_ID_*_Val, or the peripheral's *_GCLK_ID
+ */
+void clock_connect(uint8_t id, uint8_t gen);
+
+static inline const ClockRate_t * clock_gen(uint8_t gen) {
+  return &clock_gens[gen];
+}
+
+// The generator a peripheral channel runs on, connected with clock_connect()
+// or in _conf_clocks(). Until then it's clock_none, and converts everything
+// to 0 cycles rather than reading past clock_gens[].
+static inline const ClockRate_t * clock_channel(uint8_t id) {
+  uint8_t gen = clock_channels[id];
+  return gen == CLOCK_NONE ? &clock_none : &clock_gens[gen];
+}
+
+// The CPU, on GCLK0
+static inline const ClockRate_t * clock_cpu(void) {
+  return &clock_gens[0];
+}
+
+static inline uint32_t clock_us_to_cycles(const ClockRate_t * clock, uint32_t us) {
+  return ((uint64_t) us * clock->cycles_per_us) >> 16;
+}
+
+static inline uint32_t clock_ms_to_cycles(const ClockRate_t * clock, uint32_t ms) {
+  return ((uint64_t) ms * 1000 * clock->cycles_per_us) >> 16;
+}
+
+static inline uint32_t clock_cycles_to_us(const ClockRate_t * clock, uint32_t cycles) {
+  return ((uint64_t) cycles * clock->us_per_cycle) >> 24;
+}
+
+// busy_wait.h at whatever the CPU runs at now
+static inline void clock_busy_wait_us(uint32_t us) {
+  busy_wait_cycles(clock_us_to_cycles(clock_cpu(), us));
+}
+
+static inline void clock_busy_wait_ms(uint32_t ms) {
+  busy_wait_cycles(clock_ms_to_cycles(clock_cpu(), ms));
+}
+
+#endif
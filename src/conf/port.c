@@ -3,83 +3,95 @@
 
 #include <samd21.h>
 
-// PORT configuration in common/pinout.h
-static uint8_t porta_funcs[32] = PORTA_PINFUNCS;
-static uint8_t portb_funcs[32] = PORTB_PINFUNCS;
+/*
+    PORT configuration in common/pinout.h, grouped at compile time into
+    one pin mask per PINCFG/PMUX setting. _conf_port() writes each
+    setting to all of its pins in a half of the port with one WRCONFIG
+    store, then the direction and pull masks with one store each, so the
+    whole PORT is a handful of stores. Unused and output pins aren't
+    written and keep their PINCFG the way they come out of reset (PA30/PA31
+    stay SWD). make port-check runs this on a register model and checks
+    it against writing a pin at a time, see src/sim/port_check.c.
+*/
 
-// Autoconfigures PORT based on common/pinout.h.
-void _conf_port() {
-  // PORTA
-  for (int i = 0; i < 32; i++) {
-    switch (porta_funcs[i]) {
-      case PORT_PMUX_PMUXE_A_Val:
-      case PORT_PMUX_PMUXE_B_Val:
-      case PORT_PMUX_PMUXE_C_Val:
-      case PORT_PMUX_PMUXE_D_Val:
-      case PORT_PMUX_PMUXE_E_Val:
-      case PORT_PMUX_PMUXE_F_Val:
-      case PORT_PMUX_PMUXE_G_Val:
-      case PORT_PMUX_PMUXE_H_Val:
-        if ((i % 2) == 0) {
-          PORTA->PMUX[i / 2].bit.PMUXE = porta_funcs[i];
-        } else {
-          PORTA->PMUX[i / 2].bit.PMUXO = porta_funcs[i];
-        }
-        PORTA->PINCFG[i].reg = PORT_PINCFG_PMUXEN;
-        break;
-      case PINFUNC_INPUT: // Default config
-        PORTA->PINCFG[i].reg = PORT_PINCFG_INEN;
-        break;
-      case PINFUNC_INPUT_PULLUP:
-        PORTA->PINCFG[i].reg = PORT_PINCFG_PULLEN | PORT_PINCFG_INEN;
-        PORTA->OUTSET.reg    = (1u << i);
-        break;
-      case PINFUNC_INPUT_PULLDOWN:
-        PORTA->PINCFG[i].reg = PORT_PINCFG_PULLEN | PORT_PINCFG_INEN;
-        PORTA->OUTCLR.reg    = (1u << i);
-        break;
-      case PINFUNC_OUTPUT:
-        PORTA->DIRSET.reg = (1u << i);
-        break;
-      default:
-        break;
-    }
+// F(arg, pin, func) for each pin in a PORTx_PINFUNCS list
+#define _PORT_EACH(F, arg, ...) _PORT_EACH_(F, arg, __VA_ARGS__)
+#define _PORT_EACH_(F, a, p0, p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11, p12, p13, p14, p15, p16, p17, p18,   \
+                    p19, p20, p21, p22, p23, p24, p25, p26, p27, p28, p29, p30, p31)                              \
+  F(a, 0, p0) F(a, 1, p1) F(a, 2, p2) F(a, 3, p3) F(a, 4, p4) F(a, 5, p5) F(a, 6, p6) F(a, 7, p7) F(a, 8, p8)   \
+  F(a, 9, p9) F(a, 10, p10) F(a, 11, p11) F(a, 12, p12) F(a, 13, p13) F(a, 14, p14) F(a, 15, p15)               \
+  F(a, 16, p16) F(a, 17, p17) F(a, 18, p18) F(a, 19, p19) F(a, 20, p20) F(a, 21, p21) F(a, 22, p22)             \
+  F(a, 23, p23) F(a, 24, p24) F(a, 25, p25) F(a, 26, p26) F(a, 27, p27) F(a, 28, p28) F(a, 29, p29)             \
+  F(a, 30, p30) F(a, 31, p31)
+
+// Mask of the pins set to want
+#define _PIN_IS(want, pin, func) ((func) == (want) ? 1u << (pin) : 0) |
+#define _PINS(want, ...)         (_PORT_EACH(_PIN_IS, want, __VA_ARGS__) 0)
+
+#define _WRCONFIG_MUX(func) (PORT_WRCONFIG_WRPINCFG | PORT_WRCONFIG_PMUXEN | PORT_WRCONFIG_WRPMUX | PORT_WRCONFIG_PMUX(func))
+
+// A setting per PMUX value, then inputs and pulled inputs
+#define PORT_WRCONFIGS (_PINFUNC_MUX + 3)
+
+// PINCFG/PMUX settings, in the order of PortConf_t.pins
+static const uint32_t wrconfig[PORT_WRCONFIGS] = {
+  _WRCONFIG_MUX(0),  _WRCONFIG_MUX(1),  _WRCONFIG_MUX(2),  _WRCONFIG_MUX(3),
+  _WRCONFIG_MUX(4),  _WRCONFIG_MUX(5),  _WRCONFIG_MUX(6),  _WRCONFIG_MUX(7),
+  _WRCONFIG_MUX(8),  _WRCONFIG_MUX(9),  _WRCONFIG_MUX(10), _WRCONFIG_MUX(11),
+  _WRCONFIG_MUX(12), _WRCONFIG_MUX(13), _WRCONFIG_MUX(14), _WRCONFIG_MUX(15),
+  PORT_WRCONFIG_WRPINCFG | PORT_WRCONFIG_INEN,                        // PINFUNC_INPUT
+  PORT_WRCONFIG_WRPINCFG | PORT_WRCONFIG_INEN | PORT_WRCONFIG_PULLEN, // PINFUNC_INPUT_PULLUP/PULLDOWN
+};
+
+_Static_assert(_PINFUNC_MUX == 15, "wrconfig[] lists a setting per PMUX value");
+
+typedef struct {
+  uint32_t pins[PORT_WRCONFIGS]; // Pins to give each wrconfig[] setting
+  uint32_t dirset;
+  uint32_t outset;               // Pull-ups
+  uint32_t outclr;               // Pull-downs
+} PortConf_t;
+
+#define PORT_CONF(...)                                                                                           \
+  {                                                                                                              \
+    .pins = {                                                                                                    \
+      _PINS(0, __VA_ARGS__),  _PINS(1, __VA_ARGS__),  _PINS(2, __VA_ARGS__),  _PINS(3, __VA_ARGS__),             \
+      _PINS(4, __VA_ARGS__),  _PINS(5, __VA_ARGS__),  _PINS(6, __VA_ARGS__),  _PINS(7, __VA_ARGS__),             \
+      _PINS(8, __VA_ARGS__),  _PINS(9, __VA_ARGS__),  _PINS(10, __VA_ARGS__), _PINS(11, __VA_ARGS__),            \
+      _PINS(12, __VA_ARGS__), _PINS(13, __VA_ARGS__), _PINS(14, __VA_ARGS__), _PINS(15, __VA_ARGS__),            \
+      _PINS(PINFUNC_INPUT, __VA_ARGS__),                                                                         \
+      _PINS(PINFUNC_INPUT_PULLUP, __VA_ARGS__) | _PINS(PINFUNC_INPUT_PULLDOWN, __VA_ARGS__),                     \
+    },                                                                                                           \
+    .dirset = _PINS(PINFUNC_OUTPUT, __VA_ARGS__),                                                                \
+    .outset = _PINS(PINFUNC_INPUT_PULLUP, __VA_ARGS__),                                                          \
+    .outclr = _PINS(PINFUNC_INPUT_PULLDOWN, __VA_ARGS__),                                                        \
   }
 
-  // PORTB
-  for (int i = 0; i < 32; i++) {
-    switch (portb_funcs[i]) {
-      case PORT_PMUX_PMUXE_A_Val:
-      case PORT_PMUX_PMUXE_B_Val:
-      case PORT_PMUX_PMUXE_C_Val:
-      case PORT_PMUX_PMUXE_D_Val:
-      case PORT_PMUX_PMUXE_E_Val:
-      case PORT_PMUX_PMUXE_F_Val:
-      case PORT_PMUX_PMUXE_G_Val:
-      case PORT_PMUX_PMUXE_H_Val:
-        if ((i % 2) == 0) {
-          PORTB->PMUX[i / 2].bit.PMUXE = portb_funcs[i];
-        } else {
-          PORTB->PMUX[i / 2].bit.PMUXO = portb_funcs[i];
-        }
-        PORTB->PINCFG[i].reg = PORT_PINCFG_PMUXEN;
-        break;
-      case PINFUNC_INPUT: // Default config
-        PORTB->PINCFG[i].reg = PORT_PINCFG_INEN;
-        break;
-      case PINFUNC_INPUT_PULLUP:
-        PORTB->PINCFG[i].reg = PORT_PINCFG_PULLEN | PORT_PINCFG_INEN;
-        PORTB->OUTSET.reg    = (1u << i);
-        break;
-      case PINFUNC_INPUT_PULLDOWN:
-        PORTB->PINCFG[i].reg = PORT_PINCFG_PULLEN | PORT_PINCFG_INEN;
-        PORTB->OUTCLR.reg    = (1u << i);
-        break;
-      case PINFUNC_OUTPUT:
-        PORTB->DIRSET.reg = (1u << i);
-        break;
-      default:
-        break;
+static const PortConf_t port_conf[] = {
+  PORT_CONF(PORTA_PINFUNCS),
+  PORT_CONF(PORTB_PINFUNCS),
+};
+
+// Configures one port group, a handful of stores
+static void _conf_port_group(PortGroup * port, const PortConf_t * conf) {
+  // WRCONFIG takes one half of the port at a time
+  for (uint8_t i = 0; i < PORT_WRCONFIGS; i++) {
+    uint32_t pins = conf->pins[i];
+    if (pins & 0xFFFF) {
+      port->WRCONFIG.reg = wrconfig[i] | PORT_WRCONFIG_PINMASK(pins & 0xFFFF);
+    }
+    if (pins >> 16) {
+      port->WRCONFIG.reg = wrconfig[i] | PORT_WRCONFIG_HWSEL | PORT_WRCONFIG_PINMASK(pins >> 16);
     }
   }
-}
\ No newline at end of file
+  port->OUTSET.reg = conf->outset;
+  port->OUTCLR.reg = conf->outclr;
+  port->DIRSET.reg = conf->dirset;
+}
+
+// Autoconfigures PORT based on common/pinout.h.
+void _conf_port() {
+  for (uint8_t group = 0; group < ARRAY_SIZE(port_conf); group++) {
+    _conf_port_group(&PORT->Group[group], &port_conf[group]);
+  }
+}
@@ -0,0 +1,21 @@
+#include "../common/common.h"
+#include "conf.h"
+
+#include <samd21.h>
+
+// TC4 and TC5 paired up as one free-running 32 bit counter on GCLK0, so it
+// counts CPU cycles. The kernel uses it for cycle timestamps and for execution
+// budgets (compare channel 0), see kernel/port.h.
+void _conf_tc() {
+  TC4->COUNT32.CTRLA.reg = TC_CTRLA_MODE_COUNT32 | TC_CTRLA_WAVEGEN_NFRQ | TC_CTRLA_PRESCALER_DIV1;
+  // Keep COUNT synchronized so it can be read without a read request every time
+  TC4->COUNT32.READREQ.reg = TC_READREQ_RCONT | TC_READREQ_ADDR(TC_COUNT32_COUNT_OFFSET);
+  TC4->COUNT32.CTRLA.reg |= TC_CTRLA_ENABLE;
+  while (TC4->COUNT32.STATUS.bit.SYNCBUSY) {}
+
+  // Same priority as SysTick and PendSV so a budget overrun never lands
+  // in the middle of a context switch
+  NVIC_SetPriority(TC4_IRQn, (1u << __NVIC_PRIO_BITS) - 1);
+  IRQ_PRIORITY(TC4_IRQn, (1u << __NVIC_PRIO_BITS) - 1);
+  NVIC_EnableIRQ(TC4_IRQn);
+}
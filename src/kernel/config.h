@@ -0,0 +1,126 @@
+#ifndef _KERNEL_CONFIG_H
+#define _KERNEL_CONFIG_H
+
+/*
+    Kernel build configuration. Anything here can be overridden
+    with a -D in the Makefile.
+*/
+
+// Scheduling policies for KERNEL_SCHED
+#define SCHED_RMS (0) // Fixed priority, deadline monotonic by default (RMS for implicit deadlines)
+#define SCHED_EDF (1) // Earliest deadline first
+
+#ifndef KERNEL_SCHED
+#define KERNEL_SCHED (SCHED_EDF)
+#endif
+
+#ifndef KERNEL_CPU_HZ
+#define KERNEL_CPU_HZ (48000000ul) // GCLK_HZ(0) in conf/clocks.h, checked in port.c
+#endif
+
+#ifndef KERNEL_TICK_HZ
+#define KERNEL_TICK_HZ (1000ul)
+#endif
+
+#define KERNEL_CYCLES_PER_TICK (KERNEL_CPU_HZ / KERNEL_TICK_HZ)
+
+#ifndef KERNEL_MAX_TASKS
+#define KERNEL_MAX_TASKS (8)
+#endif
+
+// Enforce WCET budgets with the TC4 compare, see port.h. A job that runs
+// past its budget runs its backup, or gets its task's deadline policy. Firm
+// and hard jobs are stopped in their own slot instead of eating into time
+// the admission test promised to someone else, soft ones run on.
+#ifndef KERNEL_BUDGET
+#define KERNEL_BUDGET (1)
+#endif
+
+// Detect harmonic task sets in kernel_init(). They get a cheaper tick and,
+// under RMS, the exact U <= 1 admission bound. See _harmonic_init() in kernel.c
+#ifndef KERNEL_HARMONIC
+#define KERNEL_HARMONIC (1)
+#endif
+
+// Run the CPU off a divided GCLK0 whenever the task set has the slack for
+// it, see kernel_init(). KERNEL_DVFS_DIVS lists the dividers to pick from
+// as DIV(n), 1 first and ascending. Each has to divide KERNEL_CYCLES_PER_TICK.
+// port.c works out everything a switch needs for each at compile time.
+#ifndef KERNEL_DVFS
+#define KERNEL_DVFS (0)
+#endif
+
+#ifndef KERNEL_DVFS_DIVS
+#define KERNEL_DVFS_DIVS(DIV) DIV(1) DIV(2) DIV(3) DIV(4) DIV(6) DIV(8) // 48 MHz down to 6 MHz
+#endif
+
+// Track the worst case cost of kernel_tick(), see kernel_tick_cycles()
+#ifndef KERNEL_TICK_STATS
+#define KERNEL_TICK_STATS (0)
+#endif
+
+// Per-task measurements: CPU time over a sliding window and response time and
+// release jitter histograms, see kernel_task_utilization(). The window is
+// KERNEL_STATS_SLOTS slots of KERNEL_STATS_SLOT_TICKS, and slides a slot at a
+// time. Make it a multiple of the longest period so utilization doesn't
+// swing with how many releases land in it. Around 84 bytes of RAM per task,
+// so it's off unless asked for. make sim always has it on.
+#ifndef KERNEL_STATS
+#define KERNEL_STATS (0)
+#endif
+
+#ifndef KERNEL_STATS_SLOTS
+#define KERNEL_STATS_SLOTS (4)
+#endif
+
+#ifndef KERNEL_STATS_SLOT_TICKS
+#define KERNEL_STATS_SLOT_TICKS (250) // 1 s window by default
+#endif
+
+// Record scheduling events into a RAM ring buffer, see trace.h
+#ifndef KERNEL_TRACE
+#define KERNEL_TRACE (0)
+#endif
+
+#ifndef KERNEL_TRACE_SIZE
+#define KERNEL_TRACE_SIZE (64) // Events, 8 bytes each. Power of 2
+#endif
+
+// Logic analyser markers on PINFUNC_OUTPUT pins (PIN_PAxx), or -1 for none.
+// Driven through the IOBUS, with or without KERNEL_TRACE, see trace.h
+#ifndef KERNEL_TRACE_PIN
+#define KERNEL_TRACE_PIN (-1) // High while a task runs, low in idle
+#endif
+
+#ifndef KERNEL_TRACE_ISR_PIN
+#define KERNEL_TRACE_ISR_PIN (-1) // High from trace_isr_enter() to trace_isr_exit()
+#endif
+
+// Sample the interrupted PC from TC3 into a histogram, see profile.h
+#ifndef KERNEL_PROFILE
+#define KERNEL_PROFILE (0)
+#endif
+
+#ifndef KERNEL_PROFILE_HZ
+#define KERNEL_PROFILE_HZ (1000) // Samples per second, at least 733 (16 bit period)
+#endif
+
+#ifndef KERNEL_PROFILE_BUCKET
+#define KERNEL_PROFILE_BUCKET (128) // Bytes of code per histogram bucket. Power of 2
+#endif
+
+#ifndef KERNEL_PROFILE_RAM
+#define KERNEL_PROFILE_RAM (512) // Bytes of code from the start of RAM (make ramfunc) covered too
+#endif
+
+// The idle task sleeps and steps coroutine tasks on its own stack. It holds
+// the context switch frame (68 bytes with the alignment word), _idle_entry(),
+// the deepest coroutine step, and _job_done() under it with the deadline,
+// stats and trace recording. make stack-analyze reports what the build
+// needs, and make stack-fit sets this to it. The default leaves room for a
+// few levels of coroutine calls on top of the kernel's part.
+#ifndef KERNEL_IDLE_STACK_SIZE
+#define KERNEL_IDLE_STACK_SIZE (320) // Bytes
+#endif
+
+#endif
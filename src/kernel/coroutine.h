@@ -0,0 +1,71 @@
+#ifndef _COROUTINE_H
+#define _COROUTINE_H
+
+#include "../common/common.h"
+
+/*
+    Stackless coroutine tasks, in the style of protothreads. A task with
+    a coroutine instead of a job has no stack of its own. Each release
+    resumes the coroutine where it last yielded and runs it to its next
+    PT_YIELD, PT_WAIT_UNTIL or PT_END, on the idle task's stack.
+
+    All the state a coroutine keeps between releases is its Pt_t (2
+    bytes in the TCB) plus whatever it keeps in statics. Locals don't
+    survive a yield.
+
+    Coroutine steps can be preempted by thread tasks, but never by each
+    other, since they share the idle stack. Admission counts the longest
+    lower priority step as blocking. Switching between coroutines, or
+    from idle to one, never saves or restores registers.
+
+      static void blink(Pt_t * pt, void * arg) {
+        PT_BEGIN(pt);
+        while (1) {
+          led_on();
+          PT_YIELD(pt);  // Job done, resumes here next release
+          led_off();
+          PT_YIELD(pt);
+        }
+        PT_END(pt);
+      }
+
+    Like all protothreads, these are a switch statement underneath, so a
+    coroutine can't use switch itself across a yield.
+*/
+
+typedef uint16_t Pt_t; // Line to resume at, 0 = the start
+
+#define PT_BEGIN(pt) \
+  switch (*(pt)) {   \
+    case 0:
+
+// End this job, the next release carries on after it
+#define PT_YIELD(pt)     \
+  do {                   \
+    *(pt) = __LINE__;    \
+    return;              \
+    case __LINE__:;      \
+  } while (0)
+
+// End jobs until one is released with cond true
+#define PT_WAIT_UNTIL(pt, cond) \
+  do {                          \
+    *(pt) = __LINE__;           \
+    case __LINE__:              \
+      if (!(cond)) {            \
+        return;                 \
+      }                         \
+  } while (0)
+
+// Start over from PT_BEGIN on the next release
+#define PT_RESTART(pt) \
+  do {                 \
+    *(pt) = 0;         \
+    return;            \
+  } while (0)
+
+#define PT_END(pt) \
+  }                \
+  *(pt) = 0
+
+#endif
@@ -0,0 +1,33 @@
+#include "deadline.h"
+
+#include "kernel.h"
+
+void deadline_record(DeadlineStats_t * stats, int32_t lateness) {
+  uint32_t bucket = 0;
+
+  if (lateness > 0) {
+    if ((uint32_t) lateness > stats->max_lateness) {
+      stats->max_lateness = lateness;
+    }
+
+    // Integer log2. The M0+ has no CLZ, and this only runs for late jobs anyways
+    bucket = 1;
+    for (uint32_t l = (uint32_t) lateness >> 1; l && bucket < DEADLINE_HIST_BUCKETS - 1; l >>= 1) {
+      LOOP_BOUND(DEADLINE_HIST_BUCKETS);
+      bucket++;
+    }
+  }
+
+  if (stats->hist[bucket] != UINT16_MAX) {
+    stats->hist[bucket]++;
+  }
+}
+
+// Default hard deadline handler. Split off from Dummy_Handler so missed
+// hard deadlines are obvious in the debugger. Override it to put the system
+// into a safe state.
+__attribute__((weak)) void deadline_fault_handler(Task_t * task) {
+  UNUSED(task);
+  while (1) {
+  }
+}
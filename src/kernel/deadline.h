@@ -0,0 +1,37 @@
+#ifndef _DEADLINE_H
+#define _DEADLINE_H
+
+#include <stdint.h>
+
+/**
+ * What the kernel does with a job that is still running at its deadline.
+ * Loosely follows the hard/firm/soft penalty split in notes.md.
+ */
+typedef enum {
+  DEADLINE_CONTINUE, // Soft: let the job finish and record how late it was
+  DEADLINE_SKIP,     // Let the job finish, but drop the next release so the task catches back up
+  DEADLINE_ABORT,    // Firm: a late result is worthless. Kill the job and wait for the next release
+  DEADLINE_FAULT,    // Hard: a miss is a system failure. Call deadline_fault_handler()
+} DeadlinePolicy_t;
+
+// Lateness histogram. Bucket 0 counts jobs that made their deadline, bucket n > 0
+// counts jobs that finished [2^(n-1), 2^n) ticks late. The last bucket catches everything
+// past that. Aborted jobs never finish, so they only show up in `aborts`.
+#define DEADLINE_HIST_BUCKETS (8)
+
+typedef struct {
+  uint16_t hist[DEADLINE_HIST_BUCKETS]; // Saturating counts
+  uint16_t misses;                      // Deadline misses detected, whatever the policy
+  uint16_t aborts;                      // Jobs killed by DEADLINE_ABORT
+  uint32_t max_lateness;                // Ticks
+} DeadlineStats_t;
+
+/**
+ * @brief Record a finished job in the lateness histogram.
+ *
+ * @param stats Task's deadline statistics
+ * @param lateness Ticks past the deadline the job finished, rounded up. <= 0 if it was on time.
+ */
+void deadline_record(DeadlineStats_t * stats, int32_t lateness);
+
+#endif
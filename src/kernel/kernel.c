@@ -0,0 +1,1118 @@
+#include "kernel.h"
+
+#include "port.h"
+#include "precedence.h"
+#include "trace.h"
+
+#if defined(__arm__)
+// The next indirect call goes to this TaskConf_t field of some task. Lets
+// stack_analyze.py follow it through task_table, see INDIRECT_CALL().
+#define TASK_CALLBACK(field)                                             \
+  __asm__ volatile(".pushsection .task_callbacks, \"\", %%progbits\n" \
+                   ".word 1f, %c0\n"                                   \
+                   ".popsection\n"                                     \
+                   "1:" ::"i"(offsetof(TaskConf_t, field)))
+
+// Where stack_analyze.py finds the rest of a TaskConf_t in task_table
+#define TASK_LAYOUT()                                                  \
+  __asm__ volatile(".pushsection .task_layout, \"\", %%progbits\n" \
+                   ".word %c0, %c1, %c2, %c3, %c4, %c5, %c6\n"      \
+                   ".popsection" ::"i"(sizeof(TaskConf_t)),          \
+                   "i"(offsetof(TaskConf_t, name)),                  \
+                   "i"(offsetof(TaskConf_t, stack)),                 \
+                   "i"(offsetof(TaskConf_t, stack_size)),            \
+                   "i"(offsetof(TaskConf_t, job)),                   \
+                   "i"(offsetof(TaskConf_t, check)),                 \
+                   "i"(offsetof(TaskConf_t, backup)))
+
+// KERNEL_CPU_HZ and KERNEL_TICK_HZ, for the scripts that turn cycles into time
+#define KERNEL_CLOCK()                                                 \
+  __asm__ volatile(".pushsection .kernel_clock, \"\", %%progbits\n" \
+                   ".word %c0, %c1\n"                               \
+                   ".popsection" ::"i"(KERNEL_CPU_HZ),              \
+                   "i"(KERNEL_TICK_HZ))
+#else
+#define TASK_CALLBACK(field)
+#define TASK_LAYOUT()
+#define KERNEL_CLOCK()
+#endif
+
+static Task_t tasks[KERNEL_MAX_TASKS];
+static uint8_t tasks_num;
+
+static Task_t idle;
+static Task_t * current = &idle;
+static Task_t * context = &idle; // Whose stack is live. The idle task's while a coroutine runs
+static Task_t * stepping;        // Coroutine in the middle of a step, see coroutine.h
+
+static uint32_t idle_stack[KERNEL_IDLE_STACK_SIZE / 4] __noinit __attribute__((aligned(8)));
+
+static volatile uint32_t ticks;
+static uint32_t switched_at; // port_cycles() when current was last switched in
+static uint32_t switches;
+
+#if KERNEL_HARMONIC
+// Harmonic fast path. Every release and deadline lands on a multiple of the
+// shortest period, so the tick only compares against the next one of those.
+// Levels are the distinct periods, shortest first. At each multiple, level
+// l + 1 is due every ratio[l + 1] times level l is, and a task is due with
+// every level at or below its own, so the tasks due are a prefix mask.
+static bool harmonic;
+static uint32_t harmonic_next; // Next tick with anything due
+static uint32_t harmonic_base; // Shortest period
+static uint8_t harmonic_levels;
+static uint32_t harmonic_ratio[KERNEL_MAX_TASKS];
+static uint32_t harmonic_count[KERNEL_MAX_TASKS]; // Countdown to the level's next release
+static uint32_t harmonic_mask[KERNEL_MAX_TASKS];  // TASK_BITs due at the level
+#endif
+
+#if KERNEL_TICK_STATS
+static uint32_t tick_cycles; // Worst case kernel_tick()
+#endif
+
+#if KERNEL_DVFS
+// Clock scaling. The CPU runs at the slowest dvfs_divs[] the admission
+// test still passes at, with every C scaled up by the divider. Under EDF
+// it's cycle-conserving: a job counts its full WCET from its release, and
+// only what it actually used once it's done, until its next release. So
+// the clock only has to go up at a release, in the tick, and the tick is
+// where it changes. Under RMS kernel_init() picks it once.
+#define _DVFS_DIV(div) (div),
+static const uint8_t dvfs_divs[] = {KERNEL_DVFS_DIVS(_DVFS_DIV)};
+static uint8_t dvfs_level;   // dvfs_divs[] running now
+static uint32_t dvfs_switch; // Switch latency, full speed cycles
+#if KERNEL_SCHED == SCHED_EDF
+static uint32_t dvfs_bound;                    // Admission bound, 16.16 fixed point
+static uint32_t dvfs_total;                    // Demand, 16.16 fixed point
+static uint32_t dvfs_recip[KERNEL_MAX_TASKS];  // 2^40 / (D * KERNEL_CYCLES_PER_TICK), rounded up
+static uint32_t dvfs_demand[KERNEL_MAX_TASKS]; // C/D of each task's current job, 16.16 fixed point
+#else
+static uint8_t dvfs_pick; // dvfs_divs[] kernel_init() picked
+#endif
+#endif
+
+#if KERNEL_STATS
+static uint8_t window_slot;     // Slot of Task_t.window being filled
+static uint8_t window_full;     // Slots before it that are complete, up to KERNEL_STATS_SLOTS - 1
+static uint16_t window_ticks;   // Ticks into the current slot
+static uint32_t window_started; // port_cycles() when the current slot started
+#endif
+
+// Wraparound-safe time and key comparisons
+static inline bool time_reached(uint32_t now, uint32_t t) {
+  return (int32_t) (now - t) >= 0;
+}
+
+static inline bool key_before(uint32_t a, uint32_t b) {
+  return (int32_t) (a - b) < 0;
+}
+
+// Key a task competes with. Under fixed priorities, a job that has started
+// runs at its preemption threshold until it's done.
+static inline uint32_t _key(const Task_t * task) {
+#if KERNEL_SCHED == SCHED_RMS
+  return (task->flags & TASK_FLAG_STARTED) ? task->threshold : task->key;
+#else
+  return task->key;
+#endif
+}
+
+// True if ready job a should run instead of b. On a tie a started job keeps
+// the CPU, which is what makes a threshold equal to a task's priority block it.
+static inline bool _runs_before(const Task_t * a, const Task_t * b) {
+  uint32_t key_a = _key(a);
+  uint32_t key_b = _key(b);
+  return key_before(key_a, key_b) || (key_a == key_b && (a->flags & TASK_FLAG_STARTED) && !(b->flags & TASK_FLAG_STARTED));
+}
+
+static inline bool _is_coroutine(const Task_t * task) {
+  return task != &idle && task->conf->coroutine;
+}
+
+// Record a task event. Interrupts must be disabled.
+static inline void _trace(uint8_t type, const Task_t * task) {
+#if KERNEL_TRACE
+  if (task == &idle) {
+    trace_event_locked(TRACE_INFO(type, TRACE_IDLE, 0));
+  } else {
+    uint32_t addr = (uintptr_t) (task->conf->job ? (void *) task->conf->job : (void *) task->conf->coroutine);
+    trace_event_locked(TRACE_INFO(type, task - tasks, addr & 0xFFFF));
+  }
+#else
+  trace_marker(TRACE_INFO(type, task == &idle ? TRACE_IDLE : 0, 0));
+#endif
+}
+
+#if KERNEL_DVFS
+#if KERNEL_SCHED == SCHED_EDF
+// A job of the task now takes this many cycles, plus the switches up at
+// its release and back down after it. Interrupts must be disabled.
+static void _dvfs_demand(Task_t * task, uint32_t cycles) {
+  uint8_t i       = task - tasks;
+  uint32_t demand = (((uint64_t) (cycles + 2 * dvfs_switch) * dvfs_recip[i]) >> 24) + 1; // Rounded up
+
+  dvfs_total += demand - dvfs_demand[i];
+  dvfs_demand[i] = demand;
+}
+#endif
+
+static void _account(uint32_t now);
+
+// Switch to the slowest divider the demand fits at. Interrupts must be disabled.
+static void _dvfs_apply(void) {
+#if KERNEL_SCHED == SCHED_EDF
+  uint8_t level = 0;
+  while (level < ARRAY_SIZE(dvfs_divs) - 1 && (uint64_t) dvfs_total * dvfs_divs[level + 1] <= dvfs_bound) {
+    LOOP_BOUND(ARRAY_SIZE(dvfs_divs));
+    level++;
+  }
+#else
+  uint8_t level = dvfs_pick;
+#endif
+
+  if (level != dvfs_level) {
+    dvfs_level = level;
+    _account(port_cycles());
+    port_clock_set(level);
+    switched_at = port_cycles(); // The stall is the kernel's, not the running job's budget
+  }
+}
+#endif
+
+/************************************
+ * JOBS
+ ************************************/
+
+// Charge the running task for its time since the last call. Interrupts must be disabled.
+static void _account(uint32_t now) {
+  uint32_t used = now - switched_at;
+  switched_at   = now;
+
+  current->cpu_cycles += used;
+  current->budget = used < current->budget ? current->budget - used : 0;
+#if KERNEL_STATS
+  current->job_cycles += used;
+  current->window[window_slot] += used;
+#endif
+}
+
+static void _job_done(Task_t * task);
+static void _optional_done(Task_t * task);
+static void _primary_failed(Task_t * task);
+
+// Every job starts here on a fresh stack, see kernel_switch(). Nothing is
+// kept on the stack between jobs, which is what lets tasks that never
+// preempt each other share one.
+static void _task_entry(void * arg) {
+  Task_t * task           = arg;
+  const TaskConf_t * conf = task->conf;
+
+  if (task->flags & TASK_FLAG_BACKUP) {
+    TASK_CALLBACK(backup);
+    conf->backup(conf->arg);
+  } else {
+    TASK_CALLBACK(job);
+    conf->job(conf->arg);
+    TASK_CALLBACK(check);
+    if (conf->check && !conf->check(conf->arg)) {
+      _primary_failed(task); // Only returns if there's no backup
+    }
+  }
+  _job_done(task);
+  WCET_END(); // The job's budget stops in _job_done()
+
+  // Only switched back in here to run the optional part in slack. Otherwise
+  // this stack is simply dropped.
+  TASK_CALLBACK(optional);
+  while (!conf->optional(conf->arg)) {}
+  _optional_done(task);
+}
+
+// The idle task. It also steps coroutine tasks: kernel_switch() points
+// current at a coroutine and switches to this context to run it.
+static void _idle_entry(void * arg) {
+  UNUSED(arg);
+
+  while (1) {
+    uint32_t primask = port_irq_save();
+    Task_t * task    = current;
+    if (task == &idle) {
+      __WFI(); // Wakes on a pending interrupt even with them disabled
+    }
+    port_irq_restore(primask);
+
+    if (task != &idle) {
+      TASK_CALLBACK(coroutine);
+      task->conf->coroutine(&task->pt, task->conf->arg);
+      _job_done(task);
+    }
+  }
+}
+
+// Throw away whatever the task is in the middle of. Interrupts must be disabled.
+static void _job_kill(Task_t * task) {
+  _trace(TRACE_BLOCK, task);
+  task->state = TASK_WAITING;
+  task->flags &= ~TASK_FLAG_STARTED;
+
+  // A step can only be dropped along with the idle stack it's running on
+  if (task == stepping) {
+    stepping = NULL;
+    idle.flags &= ~TASK_FLAG_STARTED;
+  }
+}
+
+// Switch the task's current job over to its backup. It starts on a fresh
+// stack the next time the task is switched in. Interrupts must be disabled.
+// Returns false if there's no backup to run (or this already was it).
+static bool _run_backup(Task_t * task) {
+  task->failures++;
+  if (!task->conf->backup || (task->flags & TASK_FLAG_BACKUP)) {
+    return false;
+  }
+
+  task->backups++;
+  task->budget = task->conf->backup_wcet;
+  task->flags  = (task->flags | TASK_FLAG_BACKUP) & ~TASK_FLAG_STARTED;
+  task->state  = TASK_READY;
+  return true;
+}
+
+static void _primary_failed(Task_t * task) {
+  uint32_t primask = port_irq_save();
+  if (_run_backup(task)) {
+    port_yield(); // Drops this stack
+  }
+  port_irq_restore(primask);
+}
+
+// Release a job. Interrupts must be disabled.
+static void _release(Task_t * task, uint32_t release) {
+  if (task == current) {
+    _account(port_cycles()); // The old job's time stays with the old job
+  }
+  _trace(TRACE_RELEASE, task);
+#if KERNEL_STATS
+  task->released_at = port_cycles();
+  task->job_cycles  = 0;
+#endif
+  task->release      = release;
+  task->abs_deadline = release + task->deadline;
+  task->next_release = release + task->conf->period;
+  task->budget       = task->conf->wcet;
+  task->flags &= ~(TASK_FLAG_MISSED | TASK_FLAG_STARTED | TASK_FLAG_BACKUP | TASK_FLAG_OVERRUN);
+  task->state = TASK_READY;
+#if KERNEL_SCHED == SCHED_EDF
+  task->key = task->abs_deadline;
+#if KERNEL_DVFS
+  if (task->conf->period) {
+    _dvfs_demand(task, task->conf->wcet);
+  }
+#endif
+#endif
+}
+
+static void _job_done(Task_t * task) {
+  uint32_t primask = port_irq_save();
+  uint32_t now     = ticks;
+
+  if (task == stepping) {
+    stepping = NULL; // Finished the step, nothing left on the idle stack
+  }
+
+  uint32_t cycles = port_cycles();
+  _account(cycles); // Don't charge the rest of this slice to the next job
+
+#if KERNEL_DVFS && KERNEL_SCHED == SCHED_EDF
+  // Backups are covered by the reserve, the primary keeps its full WCET
+  if (task->conf->period && !(task->flags & TASK_FLAG_BACKUP)) {
+    _dvfs_demand(task, task->conf->wcet - task->budget); // Slows down at the next tick
+  }
+#endif
+
+  deadline_record(&task->deadline_stats, (int32_t) (now - task->abs_deadline) + 1);
+#if KERNEL_STATS
+  stats_record(&task->response, cycles - task->released_at);
+  task->max_job_cycles = MAX(task->max_job_cycles, task->job_cycles);
+#endif
+
+  if (task->conf->period && time_reached(now, task->next_release)) {
+    _release(task, task->next_release); // Overran into the next period, go again right away
+  } else if (task->conf->optional && !time_reached(now, task->abs_deadline)) {
+    task->state = TASK_OPTIONAL;
+  } else {
+    _job_kill(task); // Nothing left to run
+  }
+
+  port_yield();
+  port_irq_restore(primask);
+}
+
+static void _optional_done(Task_t * task) {
+  uint32_t primask = port_irq_save();
+
+  task->optional_completed++;
+  if (task->conf->period && time_reached(ticks, task->next_release)) {
+    _release(task, task->next_release);
+  } else {
+    _job_kill(task);
+  }
+
+  port_yield();
+  port_irq_restore(primask);
+}
+
+// Optional part still running at the deadline. Interrupts must be disabled.
+static void _optional_cutoff(Task_t * task) {
+  task->optional_cutoffs++;
+  _job_kill(task);
+  if (task->conf->cutoff) {
+    TASK_CALLBACK(cutoff);
+    task->conf->cutoff(task->conf->arg);
+  }
+}
+
+// Apply the task's deadline policy to a job that is still running at its
+// deadline. Interrupts must be disabled. Returns true if a reschedule is needed.
+static bool _deadline_miss(Task_t * task) {
+  task->flags |= TASK_FLAG_MISSED;
+  task->deadline_stats.misses++;
+
+  switch (task->conf->policy) {
+    case DEADLINE_CONTINUE:
+      return false;
+    case DEADLINE_SKIP:
+      task->next_release += task->conf->period;
+      return false;
+    case DEADLINE_ABORT:
+      task->deadline_stats.aborts++;
+      _job_kill(task);
+      return true;
+    case DEADLINE_FAULT:
+      deadline_fault_handler(task);
+      return false;
+  }
+  return false;
+}
+
+// Apply the task's deadline policy to a job that used up its budget and has
+// no backup to run. Soft jobs run on, past what admission assumed for them.
+// Interrupts must be disabled. Returns true if a reschedule is needed.
+static bool _budget_overrun(Task_t * task) {
+  switch (task->conf->policy) {
+    case DEADLINE_CONTINUE:
+      task->flags |= TASK_FLAG_OVERRUN;
+      port_budget_disarm();
+      return false;
+    case DEADLINE_SKIP:
+      task->flags |= TASK_FLAG_OVERRUN;
+      task->next_release += task->conf->period;
+      port_budget_disarm();
+      return false;
+    case DEADLINE_ABORT:
+      _job_kill(task);
+      return true;
+    case DEADLINE_FAULT:
+      deadline_fault_handler(task);
+      return false;
+  }
+  return false;
+}
+
+/************************************
+ * PORT INTERFACE
+ ************************************/
+
+#if KERNEL_STATS
+// Start the next slot of the utilization window, dropping the oldest one.
+// Interrupts must be disabled.
+static void _window_slide(void) {
+  uint32_t now = port_cycles();
+  _account(now); // Charge the running task up to the slot boundary
+
+  window_ticks   = 0;
+  window_started = now;
+  window_slot    = (window_slot + 1) % KERNEL_STATS_SLOTS;
+  window_full    = MIN(window_full + 1, KERNEL_STATS_SLOTS - 1);
+
+  idle.window[window_slot] = 0;
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    LOOP_BOUND(KERNEL_MAX_TASKS);
+    tasks[i].window[window_slot] = 0;
+  }
+}
+#endif
+
+// Check one task's deadline and release. Interrupts must be disabled.
+// Returns true if a reschedule is needed.
+static bool _tick_task(Task_t * task, uint32_t now) {
+  bool resched = false;
+
+  switch (task->state) {
+    case TASK_READY:
+      if (!(task->flags & TASK_FLAG_MISSED) && time_reached(now, task->abs_deadline)) {
+        resched |= _deadline_miss(task);
+      }
+      break;
+    case TASK_OPTIONAL:
+      if (time_reached(now, task->abs_deadline)) {
+        _optional_cutoff(task);
+        resched = true;
+      }
+      break;
+    default:
+      break;
+  }
+
+  if (task->state == TASK_WAITING && task->conf->period && time_reached(now, task->next_release)) {
+    _release(task, task->next_release);
+    resched = true;
+  }
+  return resched;
+}
+
+#if KERNEL_HARMONIC
+// A multiple of the shortest period. Only visit the tasks due at it.
+static bool _harmonic_tick(uint32_t now) {
+  bool resched = false;
+  uint8_t level = 0;
+
+  harmonic_next += harmonic_base;
+  while (level + 1 < harmonic_levels && --harmonic_count[level + 1] == 0) {
+    LOOP_BOUND(KERNEL_MAX_TASKS);
+    level++;
+    harmonic_count[level] = harmonic_ratio[level];
+  }
+
+  uint32_t mask = harmonic_mask[level];
+  for (uint8_t i = 0; mask; i++, mask >>= 1) {
+    LOOP_BOUND(KERNEL_MAX_TASKS);
+    if (mask & 1) {
+      resched |= _tick_task(&tasks[i], now);
+    }
+  }
+  return resched;
+}
+#endif
+
+// SysTick. Releases periodic jobs and checks deadlines. This is the only place
+// deadlines are supervised, so dispatching costs nothing extra.
+void kernel_tick(void) {
+  uint32_t primask = port_irq_save();
+#if KERNEL_TICK_STATS
+  uint32_t start = port_cycles();
+#endif
+  uint32_t now = ++ticks;
+  bool resched = false;
+
+  if (current->state == TASK_OPTIONAL) {
+    current->reward++;
+  }
+
+#if KERNEL_STATS
+  if (++window_ticks == KERNEL_STATS_SLOT_TICKS) {
+    _window_slide();
+  }
+#endif
+
+#if KERNEL_HARMONIC
+  if (harmonic) {
+    if (now == harmonic_next) {
+      resched = _harmonic_tick(now);
+    }
+  } else
+#endif
+  {
+    for (uint8_t i = 0; i < tasks_num; i++) {
+      LOOP_BOUND(KERNEL_MAX_TASKS);
+      resched |= _tick_task(&tasks[i], now);
+    }
+  }
+
+  if (resched) {
+    port_yield();
+  }
+#if KERNEL_DVFS && KERNEL_SCHED == SCHED_EDF
+  _dvfs_apply();
+#endif
+#if KERNEL_TICK_STATS
+  tick_cycles = MAX(tick_cycles, port_cycles() - start);
+#endif
+  port_irq_restore(primask);
+}
+
+// TC4 compare. The running job used up its budget.
+void kernel_budget_expired(void) {
+  uint32_t primask = port_irq_save();
+  uint32_t now     = port_cycles();
+  _account(now);
+
+  if (current->state == TASK_READY && current->conf->wcet && !(current->flags & TASK_FLAG_OVERRUN)) {
+    if (current->budget == 0) {
+      current->overruns++;
+      if (_run_backup(current) || _budget_overrun(current)) {
+        port_yield();
+      }
+    } else {
+      port_budget_arm(now, current->budget); // Early match, go again
+    }
+  }
+
+  port_irq_restore(primask);
+}
+
+// HardFault in thread mode. If a task was running, drop the job and run its
+// backup instead. Returns false if the fault can't be pinned on a task.
+bool kernel_task_fault(void) {
+  if (current == &idle) {
+    return false;
+  }
+
+  if (current->state == TASK_OPTIONAL) {
+    _optional_cutoff(current); // Mandatory result is already in
+  } else if (!_run_backup(current)) {
+    _job_kill(current);
+  }
+  port_yield();
+  return true;
+}
+
+// Called from PendSV with the stack pointer the outgoing task will have once
+// its registers are saved. Returns the stack pointer of the incoming task, or
+// NULL if the running task carries on as it is and nothing needs saving.
+__attribute__((used)) uint32_t * kernel_switch(uint32_t * sp) {
+  uint32_t primask = port_irq_save();
+  uint32_t now     = port_cycles();
+  _account(now);
+
+  context->sp = sp;
+
+  // Mandatory parts first, optional parts only in slack, then idle. Coroutines
+  // can't preempt a step, they all run on the idle stack.
+  Task_t * next = &idle;
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    LOOP_BOUND(KERNEL_MAX_TASKS);
+    Task_t * task = &tasks[i];
+    if (task->state == TASK_READY) {
+      if (stepping && task != stepping && _is_coroutine(task)) {
+        continue;
+      }
+      if (next->state != TASK_READY || _runs_before(task, next)) {
+        next = task;
+      }
+    } else if (task->state == TASK_OPTIONAL && next->state != TASK_READY) {
+      if (next == &idle || key_before(task->key, next->key)) {
+        next = task;
+      }
+    }
+  }
+
+#if KERNEL_STATS
+  // First dispatch of a job
+  if (next != &idle && !(next->flags & (TASK_FLAG_STARTED | TASK_FLAG_BACKUP))) {
+    stats_record(&next->jitter, now - next->released_at);
+  }
+#endif
+
+  Task_t * ctx = next;
+  if (_is_coroutine(next)) {
+    next->flags |= TASK_FLAG_STARTED;
+    stepping = next;
+    ctx      = &idle;
+  }
+
+  // New job (or a fresh idle task), start it on a fresh stack. This can be
+  // the stack that was just running, when its next job is already due. The
+  // outgoing registers then get saved over the new frame's r4-r11, which
+  // don't matter for a fresh start.
+  bool fresh = false;
+  if (!(ctx->flags & TASK_FLAG_STARTED)) {
+    ctx->flags |= TASK_FLAG_STARTED;
+    if (ctx == &idle) {
+      ctx->sp = port_stack_init(idle_stack + ARRAY_SIZE(idle_stack), _idle_entry, NULL);
+    } else {
+      ctx->sp = port_stack_init(ctx->conf->stack + (ctx->conf->stack_size / 4), _task_entry, ctx);
+    }
+    fresh = true;
+  }
+
+  if (next != current) {
+    switches++;
+    if (current != &idle && current->state != TASK_WAITING) {
+      _trace(TRACE_PREEMPT, current);
+    }
+    _trace(TRACE_DISPATCH, next);
+  }
+  current = next;
+
+  Task_t * prev = context;
+  context       = ctx;
+
+#if KERNEL_BUDGET
+  // Optional parts are bounded by the deadline instead
+  if (next->state == TASK_READY && next->conf->wcet && !(next->flags & TASK_FLAG_OVERRUN)) {
+    port_budget_arm(now, next->budget);
+  } else {
+    port_budget_disarm();
+  }
+#endif
+
+  port_irq_restore(primask);
+  return (ctx == prev && !fresh) ? NULL : ctx->sp;
+}
+
+/************************************
+ * API
+ ************************************/
+
+#if KERNEL_SCHED == SCHED_RMS
+// n(2^(1/n) - 1) in 16.16 fixed point
+static const uint32_t rms_bound[] = { 65536, 54292, 51103, 49600, 48725, 48154, 47751, 47452 };
+#define RMS_BOUND_LIMIT (45426) // ln(2)
+#endif
+
+#if KERNEL_HARMONIC
+// Set up the harmonic fast path if every task is periodic with an implicit
+// deadline, released at 0, and each period divides the next longer one.
+// Precedence constraints move releases off the grid, so those don't count.
+// Returns true if the set is harmonic.
+static bool _harmonic_init(void) {
+  uint32_t period = 0;
+
+  harmonic_levels = 0;
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    const TaskConf_t * conf = tasks[i].conf;
+    if (!conf->period || conf->offset || conf->after || tasks[i].deadline != conf->period || tasks[i].next_release) {
+      return false;
+    }
+  }
+
+  // Distinct periods, shortest first
+  while (true) {
+    uint32_t next = 0;
+    for (uint8_t i = 0; i < tasks_num; i++) {
+      uint32_t p = tasks[i].conf->period;
+      if (p > period && (next == 0 || p < next)) {
+        next = p;
+      }
+    }
+    if (next == 0) {
+      break;
+    }
+    if (period && next % period) {
+      return false;
+    }
+
+    if (period == 0) {
+      harmonic_base = next;
+    }
+    harmonic_ratio[harmonic_levels] = period ? next / period : 1;
+    harmonic_count[harmonic_levels] = harmonic_ratio[harmonic_levels];
+    harmonic_mask[harmonic_levels]  = 0;
+    for (uint8_t i = 0; i < tasks_num; i++) {
+      if (tasks[i].conf->period <= next) {
+        harmonic_mask[harmonic_levels] |= TASK_BIT(i);
+      }
+    }
+    harmonic_levels++;
+    period = next;
+  }
+
+  harmonic_next = harmonic_base;
+  return harmonic_levels != 0;
+}
+#endif
+
+#if KERNEL_DVFS
+// Check KERNEL_DVFS_DIVS and time a switch to the slowest one and back.
+// Returns false if the dividers are unusable.
+static bool _dvfs_init(void) {
+  for (uint8_t i = 0; i < ARRAY_SIZE(dvfs_divs); i++) {
+    uint8_t div = dvfs_divs[i];
+    if ((i == 0 && div != 1) || (i > 0 && div <= dvfs_divs[i - 1]) || KERNEL_CYCLES_PER_TICK % div) {
+      return false;
+    }
+  }
+
+  dvfs_level  = 0;
+  dvfs_switch = port_clock_switch_cycles(ARRAY_SIZE(dvfs_divs) - 1);
+  return true;
+}
+
+#if KERNEL_SCHED == SCHED_EDF
+// Start every periodic task at its full WCET, on top of the demand that
+// doesn't shrink (backup reserve and blocking)
+static void _dvfs_admit(uint32_t fixed, uint32_t bound) {
+  dvfs_bound = bound;
+  dvfs_total = fixed;
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    Task_t * task  = &tasks[i];
+    dvfs_demand[i] = 0;
+    if (task->conf->period) {
+      uint64_t interval = (uint64_t) task->deadline * KERNEL_CYCLES_PER_TICK;
+      dvfs_recip[i]     = ((1ull << 40) + interval - 1) / interval;
+      _dvfs_demand(task, task->conf->wcet);
+    }
+  }
+}
+#endif
+#endif
+
+// CPU cycles a job of the task is admitted with
+static uint32_t _admitted_wcet(const TaskConf_t * conf) {
+  uint32_t wcet = conf->wcet;
+#if KERNEL_DVFS
+  wcet += 2 * dvfs_switch; // Up at the release, down after the job
+#endif
+  return wcet;
+}
+
+#if KERNEL_SCHED == SCHED_RMS
+// Longest one lower priority job can hold off a job of the task: one that
+// runs at a threshold at or above the task's priority, or a step of another
+// coroutine when the task is a coroutine too (they share the idle stack)
+static uint32_t _rms_blocking(const Task_t * task) {
+  uint32_t blocking = 0;
+  for (uint8_t j = 0; j < tasks_num; j++) {
+    const Task_t * other = &tasks[j];
+    bool blocks          = other->threshold <= task->key || (task->conf->coroutine && other->conf->coroutine);
+    if (other != task && other->key > task->key && blocks) {
+      blocking = MAX(blocking, _admitted_wcet(other->conf));
+    }
+  }
+  return blocking;
+}
+
+// Admission at speed 1/div. With deadline monotonic priorities, the
+// utilization test at each priority level, with that level's blocking and
+// the worst backup at or above it. Otherwise that bound doesn't hold, and
+// it's response time analysis, with the same blocking and backup.
+static bool _rms_schedulable(uint8_t div, bool monotonic, bool exact) {
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    const Task_t * task = &tasks[i];
+    if (!task->conf->period) {
+      continue;
+    }
+    uint64_t window   = (uint64_t) task->deadline * KERNEL_CYCLES_PER_TICK;
+    uint32_t blocking = _rms_blocking(task);
+
+    if (monotonic) {
+      uint64_t utilization = ((uint64_t) blocking * div << 16) / window; // 16.16 fixed point
+      uint32_t reserve     = 0;
+      uint8_t level        = 0; // Periodic tasks at or above this one
+      for (uint8_t k = 0; k < tasks_num; k++) {
+        const Task_t * other = &tasks[k];
+        if (!other->conf->period || other->key > task->key) {
+          continue;
+        }
+        uint64_t interval = (uint64_t) other->deadline * KERNEL_CYCLES_PER_TICK;
+        utilization += ((uint64_t) _admitted_wcet(other->conf) * div << 16) / interval;
+        if (other->conf->backup) {
+          reserve = MAX(reserve, (uint32_t) (((uint64_t) other->conf->backup_wcet * div << 16) / interval));
+        }
+        level++;
+      }
+
+      uint32_t bound = exact ? 1ul << 16 : level <= ARRAY_SIZE(rms_bound) ? rms_bound[level - 1] : RMS_BOUND_LIMIT;
+      if (utilization + reserve > bound) {
+        return false;
+      }
+    } else {
+      uint32_t reserve = 0;
+      for (uint8_t k = 0; k < tasks_num; k++) {
+        if (tasks[k].conf->backup && tasks[k].key <= task->key) {
+          reserve = MAX(reserve, tasks[k].conf->backup_wcet);
+        }
+      }
+
+      // R = C + B + backup + sum(ceil(R / T) * C) over the rest at or above it
+      uint64_t own      = ((uint64_t) _admitted_wcet(task->conf) + blocking + reserve) * div;
+      uint64_t response = own;
+      uint64_t last     = 0;
+      while (response != last) {
+        if (response > window) {
+          return false;
+        }
+        last     = response;
+        response = own;
+        for (uint8_t k = 0; k < tasks_num; k++) {
+          const Task_t * other = &tasks[k];
+          if (other == task || !other->conf->period || other->key > task->key) {
+            continue;
+          }
+          uint64_t period = (uint64_t) other->conf->period * KERNEL_CYCLES_PER_TICK;
+          response += (last + period - 1) / period * _admitted_wcet(other->conf) * div;
+        }
+      }
+    }
+  }
+  return true;
+}
+#endif
+
+bool kernel_init(void) {
+  TASK_LAYOUT();
+  KERNEL_CLOCK();
+  if (task_count > KERNEL_MAX_TASKS) {
+    return false;
+  }
+  tasks_num = task_count;
+
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    Task_t * task      = &tasks[i];
+    task->conf         = &task_table[i];
+    task->deadline     = task->conf->deadline ? task->conf->deadline : task->conf->period;
+    task->state        = TASK_WAITING;
+    task->next_release = task->conf->offset;
+  }
+
+  // Fold precedence constraints into release times and deadlines
+  if (!precedence_transform(tasks, tasks_num)) {
+    return false;
+  }
+
+#if KERNEL_DVFS
+  if (!_dvfs_init()) {
+    return false;
+  }
+#endif
+
+#if KERNEL_HARMONIC
+  harmonic = _harmonic_init();
+#endif
+
+#if KERNEL_SCHED == SCHED_RMS
+  // Deadline monotonic priorities unless the task sets its own, ties broken by table order
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    Task_t * task = &tasks[i];
+    task->key     = 0;
+    if (task->conf->priority) {
+      task->key = task->conf->priority - 1;
+    } else {
+      for (uint8_t j = 0; j < tasks_num; j++) {
+        if (tasks[j].deadline < task->deadline || (tasks[j].deadline == task->deadline && j < i)) {
+          task->key++;
+        }
+      }
+    }
+    task->threshold = task->conf->threshold ? task->conf->threshold - 1u : task->key;
+    if (task->threshold > task->key) {
+      return false; // Threshold below the task's own priority
+    }
+  }
+#endif
+
+  // Tasks sharing a stack must never preempt each other. They also can't have
+  // optional parts, those get preempted by any mandatory job.
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    for (uint8_t j = i + 1; j < tasks_num; j++) {
+      if (!tasks[i].conf->stack || tasks[i].conf->stack != tasks[j].conf->stack) {
+        continue;
+      }
+#if KERNEL_SCHED == SCHED_RMS
+      if (tasks[i].key < tasks[j].threshold || tasks[j].key < tasks[i].threshold || tasks[i].conf->optional || tasks[j].conf->optional) {
+        return false;
+      }
+#else
+      return false;
+#endif
+    }
+  }
+
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    const TaskConf_t * conf = tasks[i].conf;
+    if (conf->coroutine && (conf->job || conf->stack || conf->optional || conf->backup)) {
+      return false;
+    }
+  }
+
+#if KERNEL_SCHED == SCHED_RMS
+  // Explicit priorities that aren't deadline monotonic get response time analysis
+  bool monotonic = true;
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    for (uint8_t j = 0; j < tasks_num; j++) {
+      if (i != j && tasks[i].conf->period && tasks[j].conf->period && tasks[i].deadline < tasks[j].deadline && tasks[i].key >= tasks[j].key) {
+        monotonic = false;
+      }
+    }
+  }
+
+  bool exact = false;
+#if KERNEL_HARMONIC
+  // Harmonic sets are schedulable up to U <= 1 under rate monotonic priorities,
+  // as long as they're fully preemptive (thresholds add blocking)
+  exact = harmonic;
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    for (uint8_t j = 0; j < tasks_num; j++) {
+      if (tasks[i].threshold != tasks[i].key || (tasks[i].conf->period < tasks[j].conf->period && tasks[i].key > tasks[j].key)) {
+        exact = false;
+      }
+    }
+  }
+#endif
+
+#if KERNEL_DVFS
+  dvfs_pick = ARRAY_SIZE(dvfs_divs) - 1;
+  while (dvfs_pick > 0 && !_rms_schedulable(dvfs_divs[dvfs_pick], monotonic, exact)) {
+    dvfs_pick--;
+  }
+#endif
+  return _rms_schedulable(1, monotonic, exact);
+#else
+  uint32_t utilization = 0; // 16.16 fixed point
+  uint32_t reserve     = 0; // Backup slack, single fault hypothesis
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    Task_t * task = &tasks[i];
+    if (task->conf->period) {
+      uint64_t interval = (uint64_t) task->deadline * KERNEL_CYCLES_PER_TICK;
+      utilization += ((uint64_t) _admitted_wcet(task->conf) << 16) / interval;
+      if (task->conf->backup) {
+        reserve = MAX(reserve, (uint32_t) (((uint64_t) task->conf->backup_wcet << 16) / interval));
+      }
+    }
+  }
+  utilization += reserve;
+
+  // Coroutines share the idle stack, so a step can be blocked by one step of
+  // a coroutine that would otherwise lose to it
+  uint32_t blocking = 0;
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    if (!tasks[i].conf->coroutine || !tasks[i].deadline) {
+      continue;
+    }
+    for (uint8_t j = 0; j < tasks_num; j++) {
+      if (j != i && tasks[j].conf->coroutine && tasks[j].deadline >= tasks[i].deadline) {
+        blocking = MAX(blocking, (uint32_t) (((uint64_t) tasks[j].conf->wcet << 16) / ((uint64_t) tasks[i].deadline * KERNEL_CYCLES_PER_TICK)));
+      }
+    }
+  }
+  utilization += blocking;
+
+  uint32_t bound = 1ul << 16;
+#if KERNEL_DVFS
+  _dvfs_admit(reserve + blocking, bound);
+#endif
+  return utilization <= bound;
+#endif
+}
+
+void kernel_start(void) {
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    if (tasks[i].conf->period && tasks[i].next_release == 0) {
+      _release(&tasks[i], 0);
+    }
+  }
+
+  switched_at = port_cycles();
+#if KERNEL_DVFS
+  _dvfs_apply(); // Under RMS this is the speed it stays at
+#endif
+#if KERNEL_STATS
+  window_started = switched_at;
+#endif
+  port_start(idle_stack + ARRAY_SIZE(idle_stack));
+}
+
+void kernel_release(Task_t * task) {
+  uint32_t primask = port_irq_save();
+  if (task->state == TASK_WAITING) {
+    _release(task, ticks);
+    port_yield();
+  }
+  port_irq_restore(primask);
+}
+
+Task_t * kernel_task(uint8_t id) {
+  return &tasks[id];
+}
+
+uint8_t kernel_running(void) {
+  return current == &idle ? KERNEL_MAX_TASKS : current - tasks;
+}
+
+uint32_t kernel_now(void) {
+  return ticks;
+}
+
+uint32_t kernel_switches(void) {
+  return switches;
+}
+
+bool kernel_harmonic(void) {
+#if KERNEL_HARMONIC
+  return harmonic;
+#else
+  return false;
+#endif
+}
+
+uint32_t kernel_tick_cycles(void) {
+#if KERNEL_TICK_STATS
+  return tick_cycles;
+#else
+  return 0;
+#endif
+}
+
+uint8_t kernel_clock_div(void) {
+#if KERNEL_DVFS
+  return dvfs_divs[dvfs_level];
+#else
+  return 1;
+#endif
+}
+
+uint32_t kernel_task_utilization(const Task_t * task) {
+#if KERNEL_STATS
+  uint32_t primask = port_irq_save();
+  uint32_t now     = port_cycles();
+
+  uint64_t busy = 0;
+  for (uint8_t i = 0; i < KERNEL_STATS_SLOTS; i++) {
+    busy += task->window[i];
+  }
+  if (task == current) {
+    busy += now - switched_at;
+  }
+  uint64_t span = (uint64_t) window_full * KERNEL_STATS_SLOT_TICKS * KERNEL_CYCLES_PER_TICK + (now - window_started);
+  port_irq_restore(primask);
+
+  return span ? (busy << 16) / span : 0;
+#else
+  UNUSED(task);
+  return 0;
+#endif
+}
+
+uint32_t kernel_wcet_check(void) {
+  uint32_t flagged = 0;
+#if KERNEL_STATS
+  for (uint8_t i = 0; i < tasks_num; i++) {
+    const Task_t * task     = &tasks[i];
+    const TaskConf_t * conf = task->conf;
+    if (!conf->wcet) {
+      continue;
+    }
+
+    bool over = task->max_job_cycles > conf->wcet;
+    if (conf->period) {
+      uint32_t admitted = ((uint64_t) conf->wcet << 16) / ((uint64_t) conf->period * KERNEL_CYCLES_PER_TICK);
+      over |= kernel_task_utilization(task) > admitted;
+    }
+    if (over) {
+      flagged |= TASK_BIT(i);
+    }
+  }
+#endif
+  return flagged;
+}
+
+uint64_t kernel_task_cycles(const Task_t * task) {
+  uint32_t primask = port_irq_save();
+  uint64_t cycles  = task->cpu_cycles;
+  if (task == current) {
+    cycles += port_cycles() - switched_at;
+  }
+  port_irq_restore(primask);
+  return cycles;
+}
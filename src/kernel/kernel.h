@@ -0,0 +1,296 @@
+#ifndef _KERNEL_H
+#define _KERNEL_H
+
+#include "../common/common.h"
+#include "config.h"
+#include "coroutine.h"
+#include "deadline.h"
+#include "stats.h"
+
+/*
+    Small preemptive real-time kernel. Tasks are described by a
+    static table in flash (task_table, defined by the application)
+    and are scheduled by RMS or EDF, see config.h.
+
+    A task is a job function that the kernel calls once per release.
+    Returning from the job completes it. Each task runs on its own
+    stack so jobs can be preempted at any point.
+
+    Under fixed priorities every task also has a preemption threshold.
+    Once a job starts it runs at its threshold, so only tasks above the
+    threshold can preempt it. Tasks that can't preempt each other may
+    share a stack: jobs always start on an empty stack, and nothing is
+    kept on it between jobs. scripts/preempt_threshold.py picks the
+    thresholds and stack clusters offline.
+
+    Small event driven tasks can be stackless coroutines instead, see
+    coroutine.h. They run on the idle task's stack and keep 2 bytes of
+    state between jobs.
+
+    For fault tolerance a task can have a backup version of its job.
+    If the primary fails its acceptance check, faults, or overruns its
+    budget, the backup runs in its place, with the same deadline. The
+    slack for it is only reserved in admission control, so it costs no
+    CPU time until a primary actually fails.
+
+    Tasks can also follow the imprecise computation model: the job
+    is the mandatory part, and an optional part refines its result
+    using whatever slack is left before the deadline. Optional parts
+    only run when no mandatory job is ready, and are cut off at the
+    deadline.
+
+    Times are in kernel ticks unless noted otherwise.
+*/
+
+/**
+ * @brief Declare a task stack. Stacks must be 8 byte aligned (AAPCS).
+ *
+ * After make stack-fit, the size comes from the stack analysis instead
+ * (build/stack_sizes.h defines STACK_SIZE_<name> as "_, bytes").
+ *
+ * @param name Name of the stack array
+ * @param size Size in bytes, must be a multiple of 8
+ */
+#define TASK_STACK(name, size) \
+  static uint32_t name[_TASK_STACK_SIZE(STACK_SIZE_##name, size) / 4] __noinit __attribute__((aligned(8)))
+
+#define _TASK_STACK_SIZE(...)               _TASK_STACK_PICK(__VA_ARGS__, ~)
+#define _TASK_STACK_PICK(fitted, size, ...) size
+
+typedef struct {
+  const char * name;
+  void (*job)(void * arg); // Called once per release, return when the job is done
+  void * arg;              // Passed to job
+  uint32_t * stack;        // See TASK_STACK. Tasks that can't preempt each other may share one
+  uint16_t stack_size;     // Bytes
+  uint32_t period;         // 0 = aperiodic, released by kernel_release()
+  uint32_t deadline;       // Relative to the release. 0 = implicit deadline (period)
+  uint32_t offset;         // Time of the first release
+  uint32_t wcet;           // Worst case execution time, CPU cycles. Also the job's budget
+  DeadlinePolicy_t policy; // What to do if a job misses its deadline or overruns its budget
+  uint32_t after;          // TASK_BITs of tasks whose job must finish first, see precedence.h
+
+  // Stackless alternative to job, stepped once per release. Leave stack unset.
+  // See coroutine.h. Can't have an optional part or a backup.
+  void (*coroutine)(Pt_t * pt, void * arg);
+
+  // Primary/backup fault tolerance, all optional
+  bool (*check)(void * arg);  // Acceptance test, run after job. False = the primary failed
+  void (*backup)(void * arg); // Run instead if the primary fails
+  uint32_t backup_wcet;       // CPU cycles, required with a backup. Also its budget
+
+  // Fixed priority only. 1 is the highest priority
+  uint8_t priority;  // 0 = deadline monotonic. Set it for all tasks or none
+  uint8_t threshold; // Preemption threshold, at or above priority. 0 = priority (fully preemptive)
+
+  // Imprecise computation, both optional
+  bool (*optional)(void * arg); // One refinement step. Called in slack until it returns true
+  void (*cutoff)(void * arg);   // Optional part hit the deadline, keep the best result so far.
+                                // Runs in the tick interrupt, keep it short.
+} TaskConf_t;
+
+typedef enum {
+  TASK_WAITING,  // Waiting for a release
+  TASK_READY,    // Job released and not done yet (running or preempted)
+  TASK_OPTIONAL, // Mandatory part done, refining in slack until the deadline
+} TaskState_t;
+
+// Task_t.flags
+#define TASK_FLAG_MISSED  (1u << 0) // Current job has already missed its deadline
+#define TASK_FLAG_STARTED (1u << 1) // Current job has been switched in and owns the stack
+#define TASK_FLAG_BACKUP  (1u << 2) // Current job is running the backup version
+#define TASK_FLAG_OVERRUN (1u << 3) // Current job ran past its budget and carries on unbudgeted (soft policies)
+
+typedef struct Task_t {
+  uint32_t * sp; // Saved stack pointer while switched out
+  const TaskConf_t * conf;
+  uint32_t key;          // Lower runs first. RMS: priority. EDF: absolute deadline
+  uint32_t threshold;    // RMS: key while a started job runs
+  uint32_t deadline;     // Relative deadline, conf->deadline or conf->period
+  uint32_t release;      // Release time of the current job
+  uint32_t next_release; // Release time of the next job
+  uint32_t abs_deadline; // Absolute deadline of the current job
+  uint8_t state;         // TaskState_t
+  uint8_t flags;
+  Pt_t pt;               // Coroutine tasks: where the next job resumes
+  DeadlineStats_t deadline_stats;
+
+  // Reward side of the penalty/reward model in notes.md
+  uint32_t reward;             // Ticks of slack spent on optional parts
+  uint16_t optional_completed; // Optional parts that ran to completion
+  uint16_t optional_cutoffs;   // Optional parts cut off at the deadline
+
+  // Execution time, in CPU cycles. Interrupts that land while the task is
+  // running are charged to it.
+  uint64_t cpu_cycles; // Total CPU time used
+  uint32_t budget;     // Left for the current job, starts at conf->wcet
+  uint16_t overruns;   // Jobs that ran past their budget
+
+  uint16_t failures; // Primaries that failed their check, faulted or overran
+  uint16_t backups;  // Backups run
+
+#if KERNEL_STATS
+  // Measured against what admission control assumed, see kernel_wcet_check()
+  uint32_t released_at;                // port_cycles() at the current job's release
+  uint32_t job_cycles;                 // CPU time used by the current job so far
+  uint32_t max_job_cycles;             // Longest job so far
+  uint32_t window[KERNEL_STATS_SLOTS]; // CPU time per slot of the sliding window
+  StatsHist_t response;                // Release to completion
+  StatsHist_t jitter;                  // Release to first dispatch
+#endif
+} Task_t;
+
+// Defined by the application
+extern const TaskConf_t task_table[];
+extern const uint8_t task_count;
+
+/**
+ * @brief Set up the tasks in task_table and run admission control.
+ * Must be called before kernel_start().
+ *
+ * Admission is EDF: sum(C/D) <= 1 or RMS: sum(C/D) <= n(2^(1/n) - 1),
+ * using WCET and the constrained deadline. Both are sufficient tests.
+ * Under RMS it's checked at each priority level, over the n tasks at or
+ * above it, plus B/D for the longest job below it that can block it (a
+ * threshold at or above its priority). If explicit priorities aren't
+ * deadline monotonic that bound doesn't hold, and each task gets response
+ * time analysis instead, with the same blocking and backup.
+ * Aperiodic tasks are best effort and not part of admission.
+ *
+ * Backups are admitted under a single fault hypothesis: the task with
+ * the largest backup_wcet/D fails on every job, so it needs C + B before
+ * its deadline. Both tests only get easier when jobs run shorter, so any
+ * single failure is covered.
+ *
+ * A coroutine step can't be preempted by other coroutines, so each one can
+ * be blocked by the longest step of a coroutine with a later deadline (EDF,
+ * the worst of those is added as B/D) or lower priority (RMS, part of its
+ * level's blocking).
+ *
+ * Harmonic sets (every period divides the longer ones) under rate monotonic
+ * priorities are checked against the exact bound of 1 instead, see
+ * KERNEL_HARMONIC.
+ *
+ * With KERNEL_DVFS the CPU runs at the slowest KERNEL_DVFS_DIVS divider
+ * the same test still passes at, each C/D multiplied by the divider.
+ * WCETs and budgets are in CPU cycles, so they scale with it by
+ * themselves. Every periodic job is admitted with two clock switches on
+ * top of its WCET, timed here first with port_clock_switch_cycles(). The
+ * switches don't come out of the running job's budget. Under RMS
+ * the divider is picked once. Under EDF a job's C drops to what it used
+ * once it's done, until its next release, and the tick picks again.
+ * Cycle counts (trace, stats) are then CPU cycles at whatever speed.
+ *
+ * @return True if the task set is schedulable
+ */
+bool kernel_init(void);
+
+/**
+ * @brief Start the scheduler. The caller becomes the idle task.
+ */
+void kernel_start(void) __attribute__((noreturn));
+
+/**
+ * @brief Release a job of an aperiodic task. Safe to call from interrupts.
+ * Does nothing if the task still has an unfinished job.
+ *
+ * @param task Task to release
+ */
+void kernel_release(Task_t * task);
+
+/**
+ * @brief Get the TCB of a task.
+ *
+ * @param id Index of the task in task_table
+ * @return Task
+ */
+Task_t * kernel_task(uint8_t id);
+
+/**
+ * @brief Task on the CPU, or whose coroutine is being stepped.
+ *
+ * @return Index of the task in task_table, KERNEL_MAX_TASKS for the idle task
+ */
+uint8_t kernel_running(void);
+
+/**
+ * @brief Current time.
+ *
+ * @return Ticks since kernel_start()
+ */
+uint32_t kernel_now(void);
+
+/**
+ * @brief Number of context switches so far (switches to the same task don't count).
+ *
+ * @return Context switches
+ */
+uint32_t kernel_switches(void);
+
+/**
+ * @brief Whether kernel_init() found a harmonic task set and is using the
+ * harmonic fast path in the tick.
+ *
+ * @return True if harmonic
+ */
+bool kernel_harmonic(void);
+
+/**
+ * @brief GCLK0 divider the CPU runs at now, 1 without KERNEL_DVFS.
+ *
+ * @return Divider of DFLL48M
+ */
+uint8_t kernel_clock_div(void);
+
+/**
+ * @brief Worst case cost of the tick interrupt so far. Needs KERNEL_TICK_STATS.
+ *
+ * @return CPU cycles spent in kernel_tick()
+ */
+uint32_t kernel_tick_cycles(void);
+
+/**
+ * @brief CPU time used by a task, including its current time slice.
+ *
+ * @param task Task
+ * @return CPU cycles
+ */
+uint64_t kernel_task_cycles(const Task_t * task);
+
+/**
+ * @brief CPU share of a task over the sliding window (KERNEL_STATS_SLOTS *
+ * KERNEL_STATS_SLOT_TICKS, less until that much time has passed). Needs
+ * KERNEL_STATS.
+ *
+ * @param task Task
+ * @return Utilization, 16.16 fixed point
+ */
+uint32_t kernel_task_utilization(const Task_t * task);
+
+/**
+ * @brief Check the measurements against what admission control assumed. A
+ * task is flagged if one of its jobs ran longer than its WCET, or if it used
+ * more than wcet/period of the CPU over the window. Either way its WCET is
+ * underestimated, and the schedulability test can't be trusted. Needs
+ * KERNEL_STATS.
+ *
+ * @return TASK_BITs of the flagged tasks
+ */
+uint32_t kernel_wcet_check(void);
+
+/**
+ * @brief Called when a job with DEADLINE_FAULT misses its deadline or
+ * overruns its budget. Runs in the tick or budget timer interrupt. Weak,
+ * the default spins forever.
+ *
+ * @param task Task that missed its deadline
+ */
+void deadline_fault_handler(Task_t * task);
+
+// Port interface, see port.c and pendsv.s
+void kernel_tick(void);
+void kernel_budget_expired(void);
+bool kernel_task_fault(void);
+uint32_t * kernel_switch(uint32_t * sp);
+
+#endif
@@ -0,0 +1,59 @@
+/*
+    PendSV context switch for ARMv6-M (Cortex-M0+).
+
+    The hardware has already stacked r0-r3, r12, lr, pc and xpsr on
+    the task's PSP stack. This saves r4-r11 below that, which makes the
+    frame documented in port.c.
+
+    kernel_switch() runs first, so the registers are only saved when the
+    task actually changes. Yielding to the same task (a tick with nothing
+    new to run, a job finishing with nothing else ready) costs the call
+    and nothing else. The outgoing sp is computed up front and handed to
+    kernel_switch() anyway, it's only ever used once the save below has
+    been done.
+
+    STM/LDM only take r0-r7 on ARMv6-M, so r8-r11 go through r4-r7:
+    two 4 register STMs and four MOVs is the shortest way to store all
+    eight. The restore is the same in reverse, r8-r11 first so r4-r7
+    can be used as scratch before being loaded last.
+
+    scripts/switch_cycles.py models the cycle count of this file.
+*/
+
+  .syntax unified
+  .cpu cortex-m0plus
+  .thumb
+
+  .section .text.PendSV_Handler, "ax", %progbits
+  .global PendSV_Handler
+  .type PendSV_Handler, %function
+  .thumb_func
+PendSV_Handler:
+  mrs   r0, psp
+  subs  r0, #32             @ Where r4-r11 go if this task gets switched out
+  push  {r0, lr}
+  bl    kernel_switch       @ Returns the incoming sp, or 0 to carry on
+  pop   {r1, r2}            @ r1 = outgoing frame, r2 = EXC_RETURN
+  cmp   r0, #0
+  beq   1f
+
+  stmia r1!, {r4-r7}
+  mov   r4, r8
+  mov   r5, r9
+  mov   r6, r10
+  mov   r7, r11
+  stmia r1!, {r4-r7}
+
+  adds  r0, #16
+  ldmia r0!, {r4-r7}
+  mov   r8, r4
+  mov   r9, r5
+  mov   r10, r6
+  mov   r11, r7
+  msr   psp, r0             @ Points at the hardware frame now
+  subs  r0, #32
+  ldmia r0!, {r4-r7}
+
+1:
+  bx    r2
+  .size PendSV_Handler, . - PendSV_Handler
@@ -0,0 +1,155 @@
+#include "port.h"
+
+#include "../conf/clocks.h"
+#include "kernel.h"
+#include "profile.h"
+#include "trace.h"
+
+/*
+    Context switch frame, lowest address first. r4-r11 are saved by
+    PendSV (pendsv.s), the rest is stacked by the hardware on exception entry.
+
+    r4 r5 r6 r7 r8 r9 r10 r11 | r0 r1 r2 r3 r12 lr pc xpsr
+*/
+#define FRAME_WORDS (16)
+#define FRAME_R0    (8)
+#define FRAME_LR    (13)
+#define FRAME_PC    (14)
+#define FRAME_XPSR  (15)
+
+// WCETs, budgets and the cycle counter are all in KERNEL_CPU_HZ cycles
+_Static_assert(KERNEL_CPU_HZ == GCLK_HZ(0), "KERNEL_CPU_HZ doesn't match GCLK0 in conf/clocks.h");
+#if KERNEL_DVFS
+_Static_assert(GCLK0_DIVSEL == 0 && GCLK0_DIV <= 1, "KERNEL_DVFS divides GCLK0 itself, leave it undivided in conf/clocks.h");
+#endif
+
+#if KERNEL_DVFS
+// Everything a switch to each KERNEL_DVFS_DIVS divider needs, worked out
+// here so port_clock_set() doesn't divide in the tick
+typedef struct {
+  ClockRate_t rate;
+  uint32_t tick;  // SysTick cycles per tick period
+  uint32_t recip; // 2^16 / div, rounded up
+  uint8_t div;
+  uint8_t rws; // Flash wait states
+} ClockLevel_t;
+
+#define _CLOCK_LEVEL(_div)                                  \
+  {                                                         \
+    .rate  = CLOCK_RATE(GCLK_HZ(0) / (_div)),               \
+    .tick  = KERNEL_CYCLES_PER_TICK / (_div),               \
+    .recip = ((1ul << 16) + (_div) - 1) / (_div),           \
+    .div   = (_div),                                        \
+    .rws   = NVM_RWS(GCLK_HZ(0) / (_div)),                  \
+  },
+
+static const ClockLevel_t clock_levels[] = {KERNEL_DVFS_DIVS(_CLOCK_LEVEL)};
+static uint8_t clock_level; // clock_levels[] running now, see port_clock_set()
+#endif
+
+uint32_t * port_stack_init(uint32_t * top, void (*entry)(void *), void * arg) {
+  uint32_t * sp = top - FRAME_WORDS;
+  for (int i = 0; i < FRAME_WORDS; i++) {
+    sp[i] = 0;
+  }
+  sp[FRAME_R0]   = (uint32_t) arg;
+  sp[FRAME_LR]   = 0;                      // Entry never returns, fault if it does
+  sp[FRAME_PC]   = (uint32_t) entry & ~1u; // Exception return wants bit 0 clear
+  sp[FRAME_XPSR] = xPSR_T_Msk;             // Thumb state
+  return sp;
+}
+
+void port_start(uint32_t * idle_sp) {
+  NVIC_SetPriority(PendSV_IRQn, (1u << __NVIC_PRIO_BITS) - 1);
+  IRQ_PRIORITY(PendSV_IRQn, (1u << __NVIC_PRIO_BITS) - 1);
+  SysTick_Config(clock_us_to_cycles(clock_cpu(), 1000000 / KERNEL_TICK_HZ)); // Also lowest priority, so it never preempts a switch
+  IRQ_PRIORITY(SysTick_IRQn, (1u << __NVIC_PRIO_BITS) - 1);
+
+  __set_PSP((uint32_t) idle_sp);
+  __set_CONTROL(CONTROL_SPSEL_Msk);
+  __ISB();
+  profile_start();
+
+  port_yield();
+  while (1) {
+    __WFI();
+  }
+}
+
+#if KERNEL_DVFS
+void port_clock_set(uint8_t level) {
+  const ClockLevel_t * to = &clock_levels[level];
+  uint32_t primask        = port_irq_save();
+  uint32_t elapsed        = SysTick->LOAD - SysTick->VAL; // Into the tick period, at the old speed
+
+  // Wait states go up before the clock does, and down only after it has
+  if (to->rws > NVMCTRL->CTRLB.bit.RWS) {
+    NVMCTRL->CTRLB.bit.RWS = to->rws;
+  }
+  GCLK->GENDIV.reg = GCLK_GENDIV_DIV(to->div) | GCLK_GENDIV_ID(0);
+  while (GCLK->STATUS.bit.SYNCBUSY) {}
+  NVMCTRL->CTRLB.bit.RWS = to->rws;
+  clock_set(0, &to->rate);
+
+  // Finish this tick period at the new speed so ticks don't drift, only by
+  // the switch itself. Writing VAL reloads from LOAD on the next count, and
+  // once it has, LOAD goes back to a full period. Before port_start() the
+  // tick isn't running, and SysTick_Config() sets it up from clock_cpu().
+  // elapsed * old div is in full speed cycles, at most KERNEL_CYCLES_PER_TICK,
+  // and the reciprocal takes it down to the new speed.
+  if (SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) {
+    uint32_t done = ((uint64_t) elapsed * clock_levels[clock_level].div * to->recip) >> 16;
+    SysTick->LOAD = done + 1 < to->tick ? to->tick - 1 - done : 1;
+    SysTick->VAL  = 0;
+    while (SysTick->VAL == 0) {}
+    SysTick->LOAD = to->tick - 1;
+  }
+  clock_level = level;
+
+  profile_clock_changed();
+  port_irq_restore(primask);
+}
+
+uint32_t port_clock_switch_cycles(uint8_t level) {
+  uint32_t start = port_cycles();
+  port_clock_set(level);
+  uint32_t down = port_cycles() - start;
+
+  start = port_cycles();
+  port_clock_set(0);
+  uint32_t up = port_cycles() - start;
+
+  // TC4 counts slower for part of each, counting all of it as slow bounds it
+  return MAX(down, up) * clock_levels[level].div;
+}
+#endif
+
+void SysTick_Handler(void) {
+  trace_isr_enter();
+  kernel_tick();
+  trace_isr_exit();
+}
+
+// Replaces the weak one in startup_samd21.c. A fault in thread mode on PSP
+// (EXC_RETURN 0xFFFFFFFD) came from a task, so the kernel can drop the job
+// and recover. PendSV tail-chains on the way out and switches away before
+// the faulting instruction runs again. Anything else is still fatal.
+void HardFault_Handler(void) {
+  uint32_t exc_return;
+  __asm__ volatile("mov %0, lr" : "=r"(exc_return));
+
+  if ((exc_return & 0xF) == 0xD && kernel_task_fault()) {
+    __enable_irq(); // The task may have faulted inside a critical section
+    return;
+  }
+
+  while (1) {
+  }
+}
+
+void TC4_Handler(void) {
+  trace_isr_enter();
+  PORT_BUDGET_TC->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0;
+  kernel_budget_expired();
+  trace_isr_exit();
+}
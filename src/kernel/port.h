@@ -0,0 +1,96 @@
+#ifndef _PORT_H
+#define _PORT_H
+
+#include "../common/common.h"
+
+/*
+    Cortex-M0+ specifics for the kernel. Tasks run in thread mode on
+    PSP, interrupts run on MSP. Context switches happen in PendSV,
+    which runs at the lowest priority so it only ever tail-chains
+    after everything else.
+*/
+
+static inline uint32_t port_irq_save(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  return primask;
+}
+
+static inline void port_irq_restore(uint32_t primask) {
+  __set_PRIMASK(primask);
+}
+
+// Request a context switch. Happens as soon as interrupts are enabled
+// and no other handler is running.
+static inline void port_yield(void) {
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+/*
+    Cycle counter and execution budget timer. TC4/TC5 run as one 32 bit
+    counter at the CPU clock, set up in conf/tc.c. Compare channel 0
+    fires TC4_Handler when the running job's budget runs out.
+*/
+
+#define PORT_BUDGET_TC (TC4)
+
+// Shortest budget the compare is armed with, so the match is never
+// already in the past by the time it's written
+#define PORT_BUDGET_MIN_CYCLES (32u)
+
+static inline uint32_t port_cycles(void) {
+  return PORT_BUDGET_TC->COUNT32.COUNT.reg;
+}
+
+static inline void port_budget_arm(uint32_t now, uint32_t budget) {
+  PORT_BUDGET_TC->COUNT32.CC[0].reg    = now + MAX(budget, PORT_BUDGET_MIN_CYCLES);
+  PORT_BUDGET_TC->COUNT32.INTFLAG.reg  = TC_INTFLAG_MC0;
+  PORT_BUDGET_TC->COUNT32.INTENSET.reg = TC_INTENSET_MC0;
+}
+
+static inline void port_budget_disarm(void) {
+  PORT_BUDGET_TC->COUNT32.INTENCLR.reg = TC_INTENCLR_MC0;
+}
+
+/*
+    CPU clock scaling, for KERNEL_DVFS. GCLK0 is DFLL48M divided by div,
+    and the CPU, SysTick, TC4 and TC3 (KERNEL_PROFILE) all run on it. So
+    budgets and cycle counts stay in CPU cycles at any speed, only the
+    wall time they take scales with div. The tick keeps its period.
+*/
+
+/**
+ * @brief Switch GCLK0 to DFLL48M / the level'th KERNEL_DVFS_DIVS divider,
+ * with the flash wait states for it, and carry on the current tick period
+ * at the new speed. Divides nothing, it's safe to call from the tick.
+ */
+void port_clock_set(uint8_t level);
+
+/**
+ * @brief Time a switch down to a KERNEL_DVFS_DIVS level and back up to
+ * level 0, full speed.
+ *
+ * @return The slower of the two, in full speed cycles
+ */
+uint32_t port_clock_switch_cycles(uint8_t level);
+
+/**
+ * @brief Build the initial frame for a task so that the first
+ * context switch to it starts entry(arg).
+ *
+ * @param top Top of the task's stack (one past the end)
+ * @param entry Function to start, must never return
+ * @param arg Argument passed to entry
+ * @return Initial stack pointer
+ */
+uint32_t * port_stack_init(uint32_t * top, void (*entry)(void *), void * arg);
+
+/**
+ * @brief Start the tick and switch thread mode over to PSP. The
+ * caller keeps running as the idle task.
+ *
+ * @param idle_sp Top of the idle task's stack
+ */
+void port_start(uint32_t * idle_sp) __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,72 @@
+#include "precedence.h"
+
+// WCET in whole ticks, rounded up. At least 1 so deadlines along a chain
+// are strictly ordered and EDF never has to break a tie.
+static int32_t _wcet_ticks(const Task_t * task) {
+  return MAX((task->conf->wcet + KERNEL_CYCLES_PER_TICK - 1) / KERNEL_CYCLES_PER_TICK, 1ul);
+}
+
+bool precedence_transform(Task_t * tasks, uint8_t num) {
+  // Work in the frame of one period: release r = offset, deadline d = offset + D
+  int32_t r[KERNEL_MAX_TASKS];
+  int32_t d[KERNEL_MAX_TASKS];
+  bool linked = false;
+
+  for (uint8_t i = 0; i < num; i++) {
+    r[i] = tasks[i].conf->offset;
+    d[i] = tasks[i].conf->offset + tasks[i].deadline;
+
+    uint32_t after = tasks[i].conf->after;
+    for (uint8_t j = 0; j < num; j++) {
+      if ((after & TASK_BIT(j)) && (j == i || tasks[j].conf->period != tasks[i].conf->period || !tasks[i].conf->period)) {
+        return false;
+      }
+    }
+    linked |= after != 0;
+  }
+  if (!linked) {
+    return true;
+  }
+#if KERNEL_SCHED != SCHED_EDF
+  return false; // Fixed priorities don't follow the transformed deadlines
+#endif
+
+  // Relax until nothing changes. A DAG settles within num passes (longest
+  // path), so anything still changing after that is a cycle.
+  bool changed = true;
+  for (uint8_t pass = 0; changed; pass++) {
+    if (pass > num) {
+      return false;
+    }
+
+    changed = false;
+    for (uint8_t j = 0; j < num; j++) {
+      for (uint8_t i = 0; i < num; i++) {
+        if (!(tasks[j].conf->after & TASK_BIT(i))) {
+          continue;
+        }
+
+        // i -> j
+        int32_t release = r[i] + _wcet_ticks(&tasks[i]);
+        if (release > r[j]) {
+          r[j]    = release;
+          changed = true;
+        }
+        int32_t deadline = d[j] - _wcet_ticks(&tasks[j]);
+        if (deadline < d[i]) {
+          d[i]    = deadline;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  for (uint8_t i = 0; i < num; i++) {
+    if (d[i] < r[i] + _wcet_ticks(&tasks[i])) {
+      return false;
+    }
+    tasks[i].next_release = r[i];
+    tasks[i].deadline     = d[i] - r[i];
+  }
+  return true;
+}
@@ -0,0 +1,96 @@
+#ifndef _PRECEDENCE_H
+#define _PRECEDENCE_H
+
+#include "kernel.h"
+
+#include <string.h>
+
+/*
+    Precedence constraints for EDF. A task lists the tasks whose job
+    has to finish before its own job may run (TaskConf_t.after), which
+    makes the task table a DAG. Tasks in a chain must share a period,
+    so job k of a stage always follows job k of the stage before it.
+
+    Instead of blocking stages on semaphores, kernel_init() rewrites
+    release times and deadlines (Chetto & Chetto):
+
+      r*_j = max(r_j, max over i -> j of r*_i + C_i)
+      d*_i = min(d_i, min over i -> j of d*_j - C_j)
+
+    Every predecessor then has an earlier release and a strictly earlier
+    deadline than its successors, so plain EDF always finishes it first.
+    Nothing blocks, and a successor only gets switched in once its input
+    is ready.
+*/
+
+#define TASK_BIT(id) (1ul << (id))
+
+/**
+ * @brief Apply the Chetto transform to the task set. Updates each task's
+ * first release and relative deadline.
+ *
+ * @param tasks Tasks, in task_table order
+ * @param num Number of tasks
+ * @return False if the graph has a cycle, links tasks with different
+ * periods, leaves a task less time than its WCET, or the kernel isn't EDF
+ */
+bool precedence_transform(Task_t * tasks, uint8_t num);
+
+/*
+    Lock-free hand-off between stages. Single producer, single consumer
+    ring: the producer only ever writes head and the consumer only ever
+    writes tail, so neither side needs a lock or a critical section.
+    Holds size - 1 elements.
+*/
+
+typedef struct {
+  volatile uint8_t head; // Next slot to write, producer only
+  volatile uint8_t tail; // Next slot to read, consumer only
+  uint8_t size;          // Slots, power of 2
+  uint8_t elem_size;     // Bytes
+  uint8_t * buf;
+} Pipe_t;
+
+#define PIPE(name, type, slots)                                         \
+  _Static_assert(((slots) & ((slots) - 1)) == 0, "Pipe size must be 2^n"); \
+  static type name##_buf[slots];                                          \
+  static Pipe_t name = { .size = (slots), .elem_size = sizeof(type), .buf = (uint8_t *) name##_buf }
+
+/**
+ * @brief Push an element. Producer side.
+ *
+ * @param pipe Pipe
+ * @param data Element to copy in
+ * @return False if the pipe is full
+ */
+static inline bool pipe_put(Pipe_t * pipe, const void * data) {
+  uint8_t head = pipe->head;
+  uint8_t next = (head + 1) & (pipe->size - 1);
+  if (next == pipe->tail) {
+    return false;
+  }
+  memcpy(pipe->buf + head * pipe->elem_size, data, pipe->elem_size);
+  __COMPILER_BARRIER(); // Data has to land before the consumer can see it
+  pipe->head = next;
+  return true;
+}
+
+/**
+ * @brief Pop an element. Consumer side.
+ *
+ * @param pipe Pipe
+ * @param data Where to copy the element
+ * @return False if the pipe is empty
+ */
+static inline bool pipe_get(Pipe_t * pipe, void * data) {
+  uint8_t tail = pipe->tail;
+  if (tail == pipe->head) {
+    return false;
+  }
+  memcpy(data, pipe->buf + tail * pipe->elem_size, pipe->elem_size);
+  __COMPILER_BARRIER(); // Done reading before the producer can reuse the slot
+  pipe->tail = (tail + 1) & (pipe->size - 1);
+  return true;
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "profile.h"
+
+#include "../conf/clocks.h"
+#include "kernel.h"
+
+#if KERNEL_PROFILE
+
+Profile_t kernel_profile;
+
+void profile_start(void) {
+  kernel_profile.hz            = KERNEL_PROFILE_HZ;
+  kernel_profile.bucket        = KERNEL_PROFILE_BUCKET;
+  kernel_profile.flash_buckets = PROFILE_FLASH_BUCKETS;
+  kernel_profile.ram_buckets   = PROFILE_RAM_BUCKETS;
+  kernel_profile.tasks_num     = KERNEL_MAX_TASKS;
+  for (uint8_t i = 0; i < task_count; i++) {
+    LOOP_BOUND(KERNEL_MAX_TASKS);
+    uint32_t addr = (uintptr_t) (task_table[i].job ? (void *) task_table[i].job : (void *) task_table[i].coroutine);
+    kernel_profile.jobs[i] = addr & 0xFFFF;
+  }
+
+  // TC3 on GCLK0, 16 bit, wrapping at CC0
+  PM->APBCMASK.reg |= PM_APBCMASK_TC3;
+  clock_connect(TC3_GCLK_ID, 0);
+  PROFILE_TC->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV1;
+  PROFILE_TC->COUNT16.CC[0].reg = clock_us_to_cycles(clock_channel(TC3_GCLK_ID), 1000000 / KERNEL_PROFILE_HZ) - 1;
+  PROFILE_TC->COUNT16.INTENSET.reg = TC_INTENSET_OVF;
+  PROFILE_TC->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+  while (PROFILE_TC->COUNT16.STATUS.bit.SYNCBUSY) {}
+
+  // Above everything else, so handlers get sampled too
+  NVIC_SetPriority(TC3_IRQn, 0);
+  IRQ_PRIORITY(TC3_IRQn, 0);
+  NVIC_EnableIRQ(TC3_IRQn);
+}
+
+void profile_clock_changed(void) {
+  if (kernel_profile.hz) { // Started
+    PROFILE_TC->COUNT16.CC[0].reg = clock_us_to_cycles(clock_channel(TC3_GCLK_ID), 1000000 / KERNEL_PROFILE_HZ) - 1;
+  }
+}
+
+// Called from TC3_Handler with the exception frame of whatever it interrupted
+__attribute__((used)) void profile_sample(const uint32_t * frame) {
+  PROFILE_TC->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+
+  uint32_t pc     = frame[6];
+  uint32_t bucket = pc < FLASH_SIZE ? pc / KERNEL_PROFILE_BUCKET
+                                    : PROFILE_FLASH_BUCKETS + (pc - HMCRAMC0_ADDR) / KERNEL_PROFILE_BUCKET;
+  if (bucket < PROFILE_FLASH_BUCKETS + PROFILE_RAM_BUCKETS) {
+    if (kernel_profile.pcs[bucket] != UINT16_MAX) {
+      kernel_profile.pcs[bucket]++;
+    }
+  } else if (kernel_profile.other != UINT16_MAX) {
+    kernel_profile.other++;
+  }
+
+  // The stacked xPSR has the exception number of a handler it interrupted
+  kernel_profile.tasks[frame[7] & IPSR_ISR_Msk ? PROFILE_INTERRUPTS : kernel_running()]++;
+  kernel_profile.samples++;
+}
+
+// Naked so the frame is still where the stack pointer is. Bit 2 of
+// EXC_RETURN says which stack it went on: PSP for a task, MSP otherwise.
+__attribute__((naked)) void TC3_Handler(void) {
+  __asm__ volatile(".syntax unified\n"
+                   "movs r0, #4\n"
+                   "mov  r1, lr\n"
+                   "tst  r0, r1\n"
+                   "mrs  r0, msp\n"
+                   "beq  1f\n"
+                   "mrs  r0, psp\n"
+                   "1:\n"
+                   "push {r0, lr}\n" // r0 keeps the stack 8 byte aligned
+                   "bl   profile_sample\n"
+                   "pop  {r0, pc}\n"
+                   ".syntax divided");
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "../common/common.h"
+#include "config.h"
+
+/*
+    Statistical profiler. TC3 interrupts KERNEL_PROFILE_HZ times a second
+    at the highest priority, and the PC it interrupted goes into a
+    histogram of KERNEL_PROFILE_BUCKET byte buckets over flash, and the
+    first KERNEL_PROFILE_RAM bytes of RAM where make ramfunc puts code.
+    Each sample is also counted against the task that was running, or
+    against interrupts if it landed in a handler.
+
+    A sample is around 80 cycles with the exception entry and exit, so
+    0.2% of the CPU at 1 kHz. Code with interrupts disabled can't be
+    sampled, its time shows up on the instruction after it enables them.
+    Everything here compiles away to nothing without KERNEL_PROFILE.
+
+    Dump the histogram with GDB and map it to functions on the host:
+      (gdb) dump binary value profile.bin kernel_profile
+      python3 scripts/profile_export.py build/cpre458.elf profile.bin profile.txt
+    profile.txt is in the format scripts/ramfunc.py takes (make ramfunc).
+*/
+
+#define PROFILE_TC (TC3)
+
+#define PROFILE_FLASH_BUCKETS (FLASH_SIZE / KERNEL_PROFILE_BUCKET)
+#define PROFILE_RAM_BUCKETS   (KERNEL_PROFILE_RAM / KERNEL_PROFILE_BUCKET)
+
+#define PROFILE_IDLE       (KERNEL_MAX_TASKS)     // tasks[] slot of the idle task
+#define PROFILE_INTERRUPTS (KERNEL_MAX_TASKS + 1) // tasks[] slot of samples in a handler
+
+// Everything the host tool needs to read it is in here, so it's
+// independent of the config it was built with
+typedef struct {
+  uint32_t samples;                        // Taken so far
+  uint16_t hz;                             // KERNEL_PROFILE_HZ
+  uint16_t bucket;                         // KERNEL_PROFILE_BUCKET
+  uint16_t flash_buckets;                  // pcs[] over flash, from address 0
+  uint16_t ram_buckets;                    // pcs[] over RAM after those
+  uint16_t tasks_num;                      // KERNEL_MAX_TASKS
+  uint16_t other;                          // Samples outside both, saturates
+  uint32_t tasks[KERNEL_MAX_TASKS + 2];    // Samples per task in task_table order, then idle and interrupts
+  uint16_t jobs[KERNEL_MAX_TASKS];         // Job (or coroutine) of each task, to name it, same as the trace
+  uint16_t pcs[PROFILE_FLASH_BUCKETS + PROFILE_RAM_BUCKETS]; // Samples per bucket, saturate
+} Profile_t;
+
+_Static_assert((KERNEL_PROFILE_BUCKET & (KERNEL_PROFILE_BUCKET - 1)) == 0, "KERNEL_PROFILE_BUCKET must be a power of 2");
+_Static_assert(KERNEL_CPU_HZ / KERNEL_PROFILE_HZ - 1 <= UINT16_MAX, "KERNEL_PROFILE_HZ too low for the 16 bit TC3 period");
+
+#if KERNEL_PROFILE
+
+extern Profile_t kernel_profile;
+
+/**
+ * @brief Start sampling. Called from port_start() once the kernel is up.
+ */
+void profile_start(void);
+
+/**
+ * @brief Keep the sample rate after GCLK0 changes speed, see port_clock_set().
+ */
+void profile_clock_changed(void);
+
+#else
+
+static inline void profile_start(void) {}
+
+static inline void profile_clock_changed(void) {}
+
+#endif
+
+#endif
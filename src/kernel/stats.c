@@ -0,0 +1,21 @@
+#include "stats.h"
+
+#include "../common/analysis.h"
+
+void stats_record(StatsHist_t * stats, uint32_t cycles) {
+  uint32_t bucket = 0;
+
+  if (cycles > stats->max) {
+    stats->max = cycles;
+  }
+
+  // Integer log2, no CLZ on the M0+
+  for (uint32_t c = cycles >> STATS_HIST_SHIFT; c && bucket < STATS_HIST_BUCKETS - 1; c >>= 1) {
+    LOOP_BOUND(STATS_HIST_BUCKETS);
+    bucket++;
+  }
+
+  if (stats->hist[bucket] != UINT16_MAX) {
+    stats->hist[bucket]++;
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+// Log2 histogram in CPU cycles, constant memory whatever the values. Bucket 0
+// counts values below 2^STATS_HIST_SHIFT, bucket n > 0 counts
+// [2^(n-1+STATS_HIST_SHIFT), 2^(n+STATS_HIST_SHIFT)). The last bucket catches
+// everything past that.
+#define STATS_HIST_BUCKETS (12)
+#define STATS_HIST_SHIFT   (12) // 4096 cycles, 85 us at 48 MHz. The last bucket starts at 87 ms
+
+typedef struct {
+  uint16_t hist[STATS_HIST_BUCKETS]; // Saturating counts
+  uint32_t max;                      // Cycles
+} StatsHist_t;
+
+/**
+ * @brief Record a value in a histogram.
+ *
+ * @param stats Histogram
+ * @param cycles Value, CPU cycles
+ */
+void stats_record(StatsHist_t * stats, uint32_t cycles);
+
+#endif
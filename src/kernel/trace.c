@@ -0,0 +1,5 @@
+#include "trace.h"
+
+#if KERNEL_TRACE
+Trace_t kernel_trace;
+#endif
@@ -0,0 +1,149 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "../common/common.h"
+#include "config.h"
+#include "port.h"
+
+/*
+    Scheduling trace. Events go into a RAM ring buffer as two words each,
+    timestamped with the TC cycle counter (port_cycles()). The oldest
+    events are overwritten once it wraps.
+
+    Recording an event is a handful of loads and stores, around 20 cycles,
+    and everything here compiles away to nothing without KERNEL_TRACE.
+
+    Dump the buffer with GDB and decode it on the host:
+      (gdb) dump binary value trace.bin kernel_trace
+      python3 scripts/trace_export.py build/cpre458.elf trace.bin trace.json
+    Then open trace.json in chrome://tracing or ui.perfetto.dev.
+
+    KERNEL_TRACE_PIN and KERNEL_TRACE_ISR_PIN put task dispatches and
+    traced handlers on pins for a logic analyser as well, a single-cycle
+    IOBUS store each (common/gpio.h). They work without KERNEL_TRACE too.
+*/
+
+typedef enum {
+  TRACE_DISPATCH,  // Task switched in
+  TRACE_PREEMPT,   // Task switched out with its job unfinished
+  TRACE_RELEASE,   // Job released
+  TRACE_BLOCK,     // Job done or killed, waiting for the next release
+  TRACE_ISR_ENTER, // id = exception number (IPSR)
+  TRACE_ISR_EXIT,
+  TRACE_LOCK, // id = lock, chosen by the application
+  TRACE_UNLOCK,
+} TraceType_t;
+
+#define TRACE_IDLE (0xFF) // Task id of the idle task
+
+// Event info word. addr is the job (or coroutine) of the task, so the
+// exporter can name it from the ELF. Flash is 32 KB, so it fits in 16 bits.
+#define TRACE_INFO(type, id, addr) ((uint32_t) (type) | ((uint32_t) (id) << 8) | ((uint32_t) (addr) << 16))
+
+typedef struct {
+  uint32_t time; // port_cycles()
+  uint32_t info; // TRACE_INFO()
+} TraceEvent_t;
+
+typedef struct {
+  uint32_t head; // Events written so far, the next one goes in events[head % KERNEL_TRACE_SIZE]
+  TraceEvent_t events[KERNEL_TRACE_SIZE];
+} Trace_t;
+
+_Static_assert((KERNEL_TRACE_SIZE & (KERNEL_TRACE_SIZE - 1)) == 0, "KERNEL_TRACE_SIZE must be a power of 2");
+
+// Drive the marker pins for an event. The type is a constant everywhere
+// this is called from, so it folds down to the store it needs, or nothing.
+static inline void trace_marker(uint32_t info) {
+  uint8_t type = info & 0xFF;
+#if KERNEL_TRACE_PIN >= 0
+  if (type == TRACE_DISPATCH) {
+    gpio_write(KERNEL_TRACE_PIN, ((info >> 8) & 0xFF) != TRACE_IDLE);
+  }
+#endif
+#if KERNEL_TRACE_ISR_PIN >= 0
+  // A nested handler clears it on the way out of the inner one
+  if (type == TRACE_ISR_ENTER) {
+    gpio_set(KERNEL_TRACE_ISR_PIN);
+  } else if (type == TRACE_ISR_EXIT) {
+    gpio_clear(KERNEL_TRACE_ISR_PIN);
+  }
+#endif
+  UNUSED(type);
+}
+
+#if KERNEL_TRACE
+
+extern Trace_t kernel_trace;
+
+/**
+ * @brief Record an event. Interrupts must be disabled, see trace_event()
+ * otherwise.
+ *
+ * @param info TRACE_INFO()
+ */
+static inline void trace_event_locked(uint32_t info) {
+  trace_marker(info);
+  TraceEvent_t * event = &kernel_trace.events[kernel_trace.head++ & (KERNEL_TRACE_SIZE - 1)];
+  event->time          = port_cycles();
+  event->info          = info;
+}
+
+/**
+ * @brief Record an event. Safe to call from anywhere.
+ *
+ * @param info TRACE_INFO()
+ */
+static inline void trace_event(uint32_t info) {
+  uint32_t primask = port_irq_save();
+  trace_event_locked(info);
+  port_irq_restore(primask);
+}
+
+// Put these at the start and end of interrupt handlers to see them in the trace
+static inline void trace_isr_enter(void) {
+  trace_event(TRACE_INFO(TRACE_ISR_ENTER, __get_IPSR(), 0));
+}
+
+static inline void trace_isr_exit(void) {
+  trace_event(TRACE_INFO(TRACE_ISR_EXIT, __get_IPSR(), 0));
+}
+
+// Around application locks (critical sections, shared buffers, ...)
+static inline void trace_lock(uint8_t id) {
+  trace_event(TRACE_INFO(TRACE_LOCK, id, 0));
+}
+
+static inline void trace_unlock(uint8_t id) {
+  trace_event(TRACE_INFO(TRACE_UNLOCK, id, 0));
+}
+
+#else
+
+static inline void trace_event_locked(uint32_t info) {
+  trace_marker(info);
+}
+
+static inline void trace_event(uint32_t info) {
+  trace_marker(info);
+}
+
+static inline void trace_isr_enter(void) {
+  trace_marker(TRACE_INFO(TRACE_ISR_ENTER, 0, 0));
+}
+
+static inline void trace_isr_exit(void) {
+  trace_marker(TRACE_INFO(TRACE_ISR_EXIT, 0, 0));
+}
+
+static inline void trace_lock(uint8_t id) {
+  UNUSED(id);
+}
+
+static inline void trace_unlock(uint8_t id) {
+  UNUSED(id);
+}
+
+#endif
+
+#endif
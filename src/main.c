@@ -1,5 +1,6 @@
 #include "common/common.h"
 #include "conf/conf.h"
+#include "kernel/kernel.h"
 
 #include <samd21.h>
 
@@ -7,6 +8,36 @@
  * INTERRUPT HANDLERS
  ************************************/
 
+/************************************
+ * TASKS
+ ************************************/
+
+TASK_STACK(blink_stack, 256);
+
+// From build/cpre458.wcet.h once make has analysed a build, see stack-analyze.
+// Until then, a generous guess.
+#ifndef WCET_blink
+#define WCET_blink (2000u)
+#endif
+
+static void blink(void * arg) {
+  UNUSED(arg);
+  gpio_toggle(PIN_LED);
+}
+
+const TaskConf_t task_table[] = {
+  {
+    .name       = "blink",
+    .job        = blink,
+    .stack      = blink_stack,
+    .stack_size = sizeof(blink_stack),
+    .period     = 250,
+    .wcet       = WCET_blink,
+    .policy     = DEADLINE_CONTINUE,
+  },
+};
+const uint8_t task_count = ARRAY_SIZE(task_table);
+
 /************************************
  * MAIN
  ************************************/
@@ -17,8 +48,8 @@ void main() {
 
   /* INITS */
 
-  while (1) {
-    PORTA->OUTTGL.reg = PORT_PA02;
-    busy_wait_ms(48000, 250);
+  if (!kernel_init()) {
+    while (1) {} // Task set failed admission control
   }
+  kernel_start();
 }
@@ -0,0 +1,185 @@
+#include "../conf/port.c"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+    Register model check of the PORT configuration. conf/port.c groups
+    the pins by setting at compile time and writes them with WRCONFIG, a
+    half of the port at a time. This builds it for Linux against the
+    samd21.h stand-in here, runs _conf_port() on the model of the PORT
+    registers in there, and checks the registers end up the same as
+    writing PINCFG, PMUX, DIRSET, OUTSET and OUTCLR a pin at a time, the
+    way the per pin configuration did.
+
+    It's checked for the pinout in common/pinout.h, and for pinouts with
+    every pin function in both halves of the port, built with the same
+    PORT_CONF() macro. Both start from the same registers, with junk in
+    them, so a store that touches the wrong pins shows up too.
+
+    Pass arguments: build/port_check
+    Or through make: make port-check
+*/
+
+Port sim_port;
+uint32_t sim_port_stores;
+
+// Every function in each half, on odd and even pins
+#define CHECK_FUNCS_1                                                                                       \
+  0, 1, 2, 3, 4, 5, 6, 7, 8, PINFUNC_INPUT, PINFUNC_INPUT_PULLUP, PINFUNC_INPUT_PULLDOWN, PINFUNC_OUTPUT,     \
+    PINFUNC_UNUSED, 9, 15, PINFUNC_OUTPUT, PINFUNC_INPUT_PULLDOWN, PINFUNC_INPUT_PULLUP, PINFUNC_INPUT, 8, 7, \
+    6, 5, 4, 3, 2, 1, 0, PINFUNC_UNUSED, 15, 9
+
+#define CHECK_FUNCS_2                                                                                           \
+  PINFUNC_INPUT_PULLUP, 3, 3, PINFUNC_INPUT_PULLUP, PINFUNC_UNUSED, PINFUNC_OUTPUT, 0, PINFUNC_INPUT, 0, 0, 0,  \
+    PINFUNC_INPUT_PULLDOWN, PINFUNC_INPUT_PULLDOWN, 6, PINFUNC_UNUSED, 1, 1, PINFUNC_UNUSED, PINFUNC_OUTPUT,     \
+    PINFUNC_OUTPUT, 4, 4, PINFUNC_INPUT, PINFUNC_INPUT, 2, PINFUNC_INPUT_PULLUP, 5, PINFUNC_INPUT_PULLDOWN, 7, 7, \
+    PINFUNC_UNUSED, PINFUNC_UNUSED
+
+typedef struct {
+  const char * name;
+  uint8_t funcs[32];
+  const PortConf_t * conf; // NULL for port_conf[], through _conf_port()
+} PortCase_t;
+
+static const PortConf_t check_conf[] = {
+  PORT_CONF(CHECK_FUNCS_1),
+  PORT_CONF(CHECK_FUNCS_2),
+};
+
+static const PortCase_t cases[] = {
+  { "PORTA", { PORTA_PINFUNCS }, NULL },
+  { "PORTB", { PORTB_PINFUNCS }, NULL },
+  { "every function 1", { CHECK_FUNCS_1 }, &check_conf[0] },
+  { "every function 2", { CHECK_FUNCS_2 }, &check_conf[1] },
+};
+
+// What was in the registers before, so untouched pins can be told apart
+static void _model_junk(PortGroup * port) {
+  memset(port, 0, sizeof(PortGroup));
+  for (uint8_t i = 0; i < 32; i++) {
+    port->PINCFG[i].reg = (i * 37) & (PORT_PINCFG_PMUXEN | PORT_PINCFG_INEN | PORT_PINCFG_PULLEN | PORT_PINCFG_DRVSTR);
+  }
+  for (uint8_t i = 0; i < 16; i++) {
+    port->PMUX[i].reg = i * 0x5B;
+  }
+  port->DIR.reg = 0x00FF00F0;
+  port->OUT.reg = 0x0F0F3C3C;
+}
+
+// WRCONFIG, datasheet 23.8.12
+static void _model_wrconfig(PortGroup * port, uint32_t value) {
+  uint8_t base = value & PORT_WRCONFIG_HWSEL ? 16 : 0;
+  for (uint8_t i = 0; i < 16; i++) {
+    if (!(value & PORT_WRCONFIG_PINMASK(1u << i))) continue;
+    uint8_t pin = base + i;
+
+    if (value & PORT_WRCONFIG_WRPINCFG) {
+      port->PINCFG[pin].reg = (value & PORT_WRCONFIG_PMUXEN ? PORT_PINCFG_PMUXEN : 0)
+                            | (value & PORT_WRCONFIG_INEN ? PORT_PINCFG_INEN : 0)
+                            | (value & PORT_WRCONFIG_PULLEN ? PORT_PINCFG_PULLEN : 0)
+                            | (value & PORT_WRCONFIG_DRVSTR ? PORT_PINCFG_DRVSTR : 0);
+    }
+    if (value & PORT_WRCONFIG_WRPMUX) {
+      uint8_t shift          = 4 * (pin % 2);
+      uint8_t func           = (value & PORT_WRCONFIG_PMUX_Msk) >> PORT_WRCONFIG_PMUX_Pos;
+      port->PMUX[pin / 2].reg = (port->PMUX[pin / 2].reg & ~(0xF << shift)) | func << shift;
+    }
+  }
+}
+
+// Replays the logged stores (see samd21.h) in the order they were made.
+// Only one log has a store in each slot, and an empty slot reads 0,
+// which does nothing to any of them.
+static void _model_replay(PortGroup * port, uint32_t stores) {
+  for (uint32_t i = 0; i < stores; i++) {
+    _model_wrconfig(port, port->WRCONFIG_stores[i].reg);
+    port->OUT.reg |= port->OUTSET_stores[i].reg;
+    port->OUT.reg &= ~port->OUTCLR_stores[i].reg;
+    port->DIR.reg |= port->DIRSET_stores[i].reg;
+  }
+}
+
+// Pin at a time, the reference
+static void _model_pinwise(PortGroup * port, const uint8_t * funcs) {
+  for (uint8_t i = 0; i < 32; i++) {
+    uint8_t func = funcs[i];
+    if (func <= _PINFUNC_MUX) {
+      uint8_t shift        = 4 * (i % 2);
+      port->PMUX[i / 2].reg = (port->PMUX[i / 2].reg & ~(0xF << shift)) | func << shift;
+      port->PINCFG[i].reg   = PORT_PINCFG_PMUXEN;
+    } else if (func == PINFUNC_INPUT) {
+      port->PINCFG[i].reg = PORT_PINCFG_INEN;
+    } else if (func == PINFUNC_INPUT_PULLUP) {
+      port->PINCFG[i].reg = PORT_PINCFG_PULLEN | PORT_PINCFG_INEN;
+      port->OUT.reg |= 1u << i;
+    } else if (func == PINFUNC_INPUT_PULLDOWN) {
+      port->PINCFG[i].reg = PORT_PINCFG_PULLEN | PORT_PINCFG_INEN;
+      port->OUT.reg &= ~(1u << i);
+    } else if (func == PINFUNC_OUTPUT) {
+      port->DIR.reg |= 1u << i;
+    }
+  }
+}
+
+static bool _compare(const char * name, const PortGroup * port, const PortGroup * want) {
+  bool same = true;
+  for (uint8_t i = 0; i < 32; i++) {
+    if (port->PINCFG[i].reg != want->PINCFG[i].reg) {
+      printf("  %s pin %u: PINCFG 0x%02x, should be 0x%02x\n", name, i, port->PINCFG[i].reg, want->PINCFG[i].reg);
+      same = false;
+    }
+  }
+  for (uint8_t i = 0; i < 16; i++) {
+    if (port->PMUX[i].reg != want->PMUX[i].reg) {
+      printf("  %s PMUX[%u]: 0x%02x, should be 0x%02x\n", name, i, port->PMUX[i].reg, want->PMUX[i].reg);
+      same = false;
+    }
+  }
+  if (port->DIR.reg != want->DIR.reg) {
+    printf("  %s DIR: 0x%08x, should be 0x%08x\n", name, port->DIR.reg, want->DIR.reg);
+    same = false;
+  }
+  if (port->OUT.reg != want->OUT.reg) {
+    printf("  %s OUT: 0x%08x, should be 0x%08x\n", name, port->OUT.reg, want->OUT.reg);
+    same = false;
+  }
+  return same;
+}
+
+int main() {
+  printf("-- PORT configuration, WRCONFIG against a pin at a time --\n");
+
+  static PortGroup want;
+  bool ok = true;
+  for (uint8_t i = 0; i < ARRAY_SIZE(cases); i++) {
+    const PortCase_t * test = &cases[i];
+    PortGroup * port        = &sim_port.Group[test->conf ? 0 : i];
+
+    _model_junk(&sim_port.Group[0]);
+    _model_junk(&sim_port.Group[1]);
+    sim_port_stores = 0;
+    if (test->conf) {
+      _conf_port_group(port, test->conf);
+    } else {
+      _conf_port();
+    }
+    if (sim_port_stores > SIM_PORT_STORES) {
+      printf("** Error: Over SIM_PORT_STORES stores to PORT **\n");
+      return 1;
+    }
+    _model_replay(port, sim_port_stores);
+
+    _model_junk(&want);
+    _model_pinwise(&want, test->funcs);
+    bool same = _compare(test->name, port, &want);
+    printf("  %-20s %3u stores  %s\n", test->name, sim_port_stores, same ? "same" : "DIFFERENT");
+    ok &= same;
+  }
+
+  if (!ok) {
+    printf("** Error: WRCONFIG configuration doesn't match **\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+#ifndef _SIM_SAMD21_H
+#define _SIM_SAMD21_H
+
+#include <stdint.h>
+
+/*
+    Host stand-in for the CMSIS device header, used by the simulator
+    build only (make sim, see sim.c). It has just what the kernel core
+    touches, so kernel/port.h compiles unchanged, and the PORT registers
+    conf/port.c writes, for the register model in port_check.c.
+
+    The registers are plain memory. The simulator polls them after each
+    call into the kernel, the way the NVIC and TC4 would react to the
+    writes. The core intrinsics call into the simulator, which is where
+    pending interrupts get taken.
+*/
+
+typedef struct {
+  volatile uint32_t reg;
+} SimReg_t;
+
+typedef struct {
+  volatile uint32_t ICSR;
+} SCB_Type;
+
+typedef struct {
+  SimReg_t COUNT; // Tracks virtual time
+  SimReg_t CC[2];
+  SimReg_t INTFLAG;
+  SimReg_t INTENSET; // Written = armed, cleared by the simulator
+  SimReg_t INTENCLR; // Written = disarmed, cleared by the simulator
+} TcCount32_t;
+
+typedef union {
+  TcCount32_t COUNT32;
+} Tc;
+
+typedef struct {
+  volatile uint8_t reg;
+} SimReg8_t;
+
+#define SIM_PORT_STORES (128)
+
+// DIRSET, OUTSET, OUTCLR and WRCONFIG act on the write, so every store
+// to them goes in the next slot of a log instead (see the defines below),
+// numbered across all of them so port_check.c can replay them in order
+typedef struct {
+  SimReg_t DIR;
+  SimReg_t DIRSET_stores[SIM_PORT_STORES];
+  SimReg_t OUT;
+  SimReg_t OUTCLR_stores[SIM_PORT_STORES];
+  SimReg_t OUTSET_stores[SIM_PORT_STORES];
+  SimReg_t OUTTGL;
+  SimReg_t IN;
+  SimReg_t WRCONFIG_stores[SIM_PORT_STORES];
+  SimReg8_t PMUX[16];
+  SimReg8_t PINCFG[32];
+} PortGroup;
+
+extern uint32_t sim_port_stores;
+
+#define DIRSET   DIRSET_stores[sim_port_stores++ % SIM_PORT_STORES]
+#define OUTCLR   OUTCLR_stores[sim_port_stores++ % SIM_PORT_STORES]
+#define OUTSET   OUTSET_stores[sim_port_stores++ % SIM_PORT_STORES]
+#define WRCONFIG WRCONFIG_stores[sim_port_stores++ % SIM_PORT_STORES]
+
+typedef struct {
+  PortGroup Group[2];
+} Port;
+
+extern SCB_Type sim_scb;
+extern Tc sim_tc4;
+extern Port sim_port;
+
+#define SCB        (&sim_scb)
+#define TC4        (&sim_tc4)
+#define PORT       (&sim_port)
+#define PORT_IOBUS (&sim_port)
+
+#define SCB_ICSR_PENDSVSET_Msk (1ul << 28)
+#define TC_INTFLAG_MC0         (1u << 4)
+#define TC_INTENSET_MC0        (1u << 4)
+#define TC_INTENCLR_MC0        (1u << 4)
+
+#define PORT_PINCFG_PMUXEN           (1u << 0)
+#define PORT_PINCFG_INEN             (1u << 1)
+#define PORT_PINCFG_PULLEN           (1u << 2)
+#define PORT_PINCFG_DRVSTR           (1u << 6)
+#define PORT_PMUX_PMUXE_Msk          (0xFu << 0)
+#define PORT_PMUX_PMUXO_Msk          (0xFu << 4)
+#define PORT_WRCONFIG_PINMASK_Msk    (0xFFFFu << 0)
+#define PORT_WRCONFIG_PINMASK(value) (PORT_WRCONFIG_PINMASK_Msk & ((value) << 0))
+#define PORT_WRCONFIG_PMUXEN         (1u << 16)
+#define PORT_WRCONFIG_INEN           (1u << 17)
+#define PORT_WRCONFIG_PULLEN         (1u << 18)
+#define PORT_WRCONFIG_DRVSTR         (1u << 22)
+#define PORT_WRCONFIG_PMUX_Pos       24
+#define PORT_WRCONFIG_PMUX_Msk       (0xFu << PORT_WRCONFIG_PMUX_Pos)
+#define PORT_WRCONFIG_PMUX(value)    (PORT_WRCONFIG_PMUX_Msk & ((value) << PORT_WRCONFIG_PMUX_Pos))
+#define PORT_WRCONFIG_WRPMUX         (1u << 28)
+#define PORT_WRCONFIG_WRPINCFG       (1u << 30)
+#define PORT_WRCONFIG_HWSEL          (1u << 31)
+
+// In sim.c
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+void __WFI(void);
+uint32_t __get_IPSR(void);
+
+#define __COMPILER_BARRIER() __asm__ volatile("" ::: "memory")
+
+static inline void __ISB(void) {}
+static inline void __DSB(void) {}
+
+#endif
@@ -0,0 +1,564 @@
+#include "../kernel/kernel.h"
+#include "../kernel/port.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+
+/*
+    Discrete-event simulator for the scheduler. `make sim` builds the
+    kernel core (kernel.c, deadline.c, precedence.c, stats.c, trace.c, all
+    unchanged) for Linux against samd21.h in this directory, and runs the
+    task set below in virtual time. Since it's the same code, it makes
+    the same scheduling decisions the target does for the same job
+    execution times.
+
+    The port layer is simulated underneath it:
+      - SysTick fires every KERNEL_CYCLES_PER_TICK and calls kernel_tick()
+      - TC4 fires when COUNT reaches the armed compare, kernel_budget_expired()
+      - PendSV calls kernel_switch(), and switches host stacks if needed
+    Interrupts are taken when unmasked, in NVIC order. All three are at
+    the lowest priority, so the lower exception number wins: PendSV (14),
+    then SysTick (15), then TC4 (35). A compare match stays pending in
+    the NVIC once it happens, even if a switch rearms the compare first.
+
+    Every target stack is a host stack, switched with _setjmp/_longjmp.
+    The stack pointers the kernel stores are really SimContext_t *, it
+    never looks inside them.
+
+    Virtual time only moves when a job burns CPU time (sim_run()) or the
+    idle task waits for an interrupt, and then straight to the next
+    event. Kernel code takes no time unless SIM_TICK_CYCLES and
+    SIM_SWITCH_CYCLES say otherwise, set them from kernel_tick_cycles()
+    and make bench-switch to match the board.
+
+    With KERNEL_DVFS, port_clock_set() divides the simulated CPU clock.
+    sim_run() cycles and TC4 are CPU cycles, so they take div times as
+    long, and each switch costs SIM_DVFS_CYCLES. The time spent at each
+    divider is printed at the end. The cpu % column is of full speed.
+      make sim CFLAGS=-DKERNEL_DVFS=1
+
+    It fails if a task overruns its WCET more often than its load drew a
+    spike.
+
+    With a profile file, the calls into each interrupt handler and the
+    kernel function behind it go there, for scripts/ramfunc.py (make ramfunc).
+
+    Pass arguments: build/kernel_sim [seconds] [seed] [profile]
+    Or through make: make sim SIM_ARGS="36000 7 build/profile.txt"
+*/
+
+#ifndef SIM_TICK_CYCLES
+#define SIM_TICK_CYCLES (0) // Charged for each kernel_tick()
+#endif
+
+#ifndef SIM_SWITCH_CYCLES
+#define SIM_SWITCH_CYCLES (0) // Charged for each PendSV
+#endif
+
+#ifndef SIM_DVFS_CYCLES
+#define SIM_DVFS_CYCLES (100) // Charged for each port_clock_set(), at the new speed
+#endif
+
+#define SIM_STACK_SIZE (64 * 1024) // Host stack per target stack
+#define SIM_CONTEXTS   (KERNEL_MAX_TASKS + 1)
+
+typedef struct {
+  uint32_t * top; // Target stack this stands in for
+  void (*entry)(void * arg);
+  void * arg;
+  bool fresh;     // Start entry(arg) the next time it's switched to
+  jmp_buf resume; // Where it was switched out
+  jmp_buf start;  // Bottom of the host stack, see _trampoline()
+  ucontext_t uc;
+} SimContext_t;
+
+SCB_Type sim_scb;
+Tc sim_tc4;
+
+static SimContext_t contexts[SIM_CONTEXTS];
+static uint8_t contexts_num;
+static SimContext_t boot; // main(), until the first switch
+static SimContext_t * running = &boot;
+static SimContext_t * creating;
+static jmp_buf created;
+static jmp_buf finished;
+
+static uint64_t now;       // Virtual time, full speed cycles
+static uint64_t cpu;       // CPU cycles, what TC4 counts
+static uint64_t cpu_frac;  // Full speed cycles towards the next CPU cycle
+static uint8_t clock_div = 1;
+#define _SIM_DIV(div) (div),
+static const uint8_t sim_divs[] = {KERNEL_DVFS_DIVS(_SIM_DIV)}; // port_clock_set() levels
+static uint64_t end;       // Stop here
+static uint64_t tick_at;   // Next SysTick
+static uint64_t budget_at; // Next TC4 compare match, UINT64_MAX when disarmed
+static bool budget_pending; // TC4 pending in the NVIC
+static uint32_t primask;
+static bool handler; // In an interrupt handler
+static uint32_t rng;
+
+// Interrupts taken, for the profile
+static uint64_t budgets_taken;
+static uint64_t switches_taken;
+static uint64_t ticks_taken;
+
+// Time at each GCLK0 divider, and switches between them
+static uint64_t div_cycles[256];
+static uint64_t clock_switches;
+
+static void _advance(uint64_t t) {
+  uint64_t span = t - now + cpu_frac;
+  div_cycles[clock_div] += t - now;
+  cpu += span / clock_div;
+  cpu_frac = span % clock_div;
+
+  now                    = t;
+  TC4->COUNT32.COUNT.reg = (uint32_t) cpu;
+}
+
+static uint64_t _next_event(void) {
+  return MIN(MIN(tick_at, budget_at), end);
+}
+
+// xorshift32, so a seed always gives the same run
+static uint32_t _random(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+/************************************
+ * CONTEXTS
+ ************************************/
+
+// First code to run on a new host stack. Marks the bottom of it, so a fresh
+// frame is just a jump back here.
+static void _trampoline(void) {
+  if (!_setjmp(creating->start)) {
+    _longjmp(created, 1);
+  }
+  running->entry(running->arg);
+  abort(); // Task and idle entries never return
+}
+
+static SimContext_t * _context(uint32_t * top) {
+  for (uint8_t i = 0; i < contexts_num; i++) {
+    if (contexts[i].top == top) {
+      return &contexts[i];
+    }
+  }
+  if (contexts_num == SIM_CONTEXTS) {
+    abort();
+  }
+
+  SimContext_t * ctx = &contexts[contexts_num++];
+  ctx->top           = top;
+  getcontext(&ctx->uc);
+  ctx->uc.uc_stack.ss_sp   = malloc(SIM_STACK_SIZE);
+  ctx->uc.uc_stack.ss_size = SIM_STACK_SIZE;
+  ctx->uc.uc_link          = NULL;
+  makecontext(&ctx->uc, _trampoline, 0);
+
+  creating = ctx;
+  if (!_setjmp(created)) {
+    setcontext(&ctx->uc);
+  }
+  return ctx;
+}
+
+static void _switch(SimContext_t * to) {
+  SimContext_t * from = running;
+  if (to == from && !to->fresh) {
+    return;
+  }
+
+  running = to;
+  if (!_setjmp(from->resume)) {
+    if (to->fresh) {
+      to->fresh = false;
+      _longjmp(to->start, 1);
+    }
+    _longjmp(to->resume, 1);
+  }
+}
+
+// The target builds an exception frame, here the stack gets restarted instead
+uint32_t * port_stack_init(uint32_t * top, void (*entry)(void *), void * arg) {
+  SimContext_t * ctx = _context(top);
+  ctx->entry         = entry;
+  ctx->arg           = arg;
+  ctx->fresh         = true;
+  return (uint32_t *) ctx;
+}
+
+/************************************
+ * INTERRUPTS
+ ************************************/
+
+// React to port_budget_arm() and port_budget_disarm()
+static void _budget_poll(void) {
+  TcCount32_t * tc = &TC4->COUNT32;
+  if (tc->INTENCLR.reg) {
+    tc->INTENCLR.reg = 0;
+    budget_at        = UINT64_MAX;
+  }
+  if (tc->INTENSET.reg) {
+    tc->INTENSET.reg = 0;
+    budget_at        = now + (uint64_t) (tc->CC[0].reg - (uint32_t) cpu) * clock_div - cpu_frac;
+  }
+}
+
+// The target changes GCLK0. Anything timed in CPU cycles stretches or
+// shrinks from here on.
+void port_clock_set(uint8_t level) {
+  uint8_t div = sim_divs[level];
+  if (budget_at != UINT64_MAX && budget_at > now) {
+    budget_at = now + (uint64_t) (TC4->COUNT32.CC[0].reg - (uint32_t) cpu) * div;
+  }
+  clock_div = div;
+  cpu_frac  = 0;
+  clock_switches++;
+  _advance(now + SIM_DVFS_CYCLES);
+}
+
+// Same as the target, it times the switches with the simulated TC4
+uint32_t port_clock_switch_cycles(uint8_t level) {
+  uint32_t start = port_cycles();
+  port_clock_set(level);
+  uint32_t down = port_cycles() - start;
+
+  start = port_cycles();
+  port_clock_set(0);
+  uint32_t up = port_cycles() - start;
+
+  return MAX(down, up) * sim_divs[level];
+}
+
+// Take whatever is pending, as the NVIC would once interrupts are unmasked
+static void _interrupts(void) {
+  if (handler || primask) {
+    return;
+  }
+
+  while (true) {
+    if (now >= end) {
+      _longjmp(finished, 1);
+    }
+
+    if (now >= budget_at) {
+      budget_at += (1ull << 32) * clock_div; // Matches again when COUNT wraps, unless rearmed
+      budget_pending = true;
+    }
+
+    handler = true;
+    if (SCB->ICSR & SCB_ICSR_PENDSVSET_Msk) {
+      SCB->ICSR     = 0;
+      uint32_t * sp = kernel_switch((uint32_t *) running);
+      switches_taken++;
+      _budget_poll();
+      _advance(now + SIM_SWITCH_CYCLES * clock_div);
+      handler = false;
+      if (sp) {
+        _switch((SimContext_t *) sp); // Back here once this stack runs again
+      }
+      continue;
+    } else if (now >= tick_at) {
+      // SysTick only pends once, however many ticks were masked
+      tick_at += ((now - tick_at) / KERNEL_CYCLES_PER_TICK + 1) * KERNEL_CYCLES_PER_TICK;
+      kernel_tick();
+      ticks_taken++;
+      _advance(now + SIM_TICK_CYCLES * clock_div);
+    } else if (budget_pending) {
+      budget_pending = false;
+      TC4->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0;
+      kernel_budget_expired();
+      budgets_taken++;
+      _budget_poll();
+    } else {
+      handler = false;
+      return;
+    }
+    handler = false;
+  }
+}
+
+uint32_t __get_PRIMASK(void) {
+  return primask;
+}
+
+void __set_PRIMASK(uint32_t value) {
+  primask = value & 1;
+  _interrupts();
+}
+
+void __disable_irq(void) {
+  primask = 1;
+}
+
+void __enable_irq(void) {
+  primask = 0;
+  _interrupts();
+}
+
+// Sleep until the next event. Interrupts are taken once they're unmasked.
+void __WFI(void) {
+  if (!(SCB->ICSR & SCB_ICSR_PENDSVSET_Msk) && !budget_pending) {
+    _advance(MAX(now, _next_event()));
+  }
+}
+
+uint32_t __get_IPSR(void) {
+  return 0;
+}
+
+void port_start(uint32_t * idle_sp) {
+  UNUSED(idle_sp);
+  tick_at        = now + KERNEL_CYCLES_PER_TICK;
+  budget_at      = UINT64_MAX;
+  clock_switches = 0; // Only count the ones while it runs
+
+  port_yield();
+  __enable_irq(); // Switches away for good
+  abort();
+}
+
+/**
+ * @brief Burn CPU time in the running task. Interrupts land in the middle
+ * of it, and the task may be preempted.
+ *
+ * @param cycles CPU cycles
+ */
+static void sim_run(uint64_t cycles) {
+  if (primask) {
+    _advance(now + cycles * clock_div); // Whatever comes due waits for the unmask
+    return;
+  }
+
+  while (cycles) {
+    uint64_t start = cpu;
+    _advance(now + MIN(cycles * clock_div, _next_event() - now));
+    cycles -= MIN(cycles, cpu - start);
+    _interrupts();
+  }
+}
+
+/************************************
+ * TASKS
+ ************************************/
+
+// Execution time distribution of a synthetic job: uniform in [min, max],
+// except one job in every `spike_odds` takes `spike` instead
+typedef struct {
+  uint8_t id;
+  uint32_t min; // CPU cycles
+  uint32_t max;
+  uint32_t spike;
+  uint32_t spike_odds; // 0 = never
+  uint64_t jobs;       // Finished, including late ones
+  uint64_t late;       // Finished past the deadline
+  uint32_t spikes;     // Jobs that drew the spike
+} SimLoad_t;
+
+static uint32_t _sample(SimLoad_t * load) {
+  if (load->spike_odds && _random() % load->spike_odds == 0) {
+    load->spikes++;
+    return load->spike;
+  }
+  return load->min + _random() % (load->max - load->min + 1);
+}
+
+static void _job(void * arg) {
+  SimLoad_t * load = arg;
+  sim_run(_sample(load));
+
+  load->jobs++;
+  if ((int32_t) (kernel_now() - kernel_task(load->id)->abs_deadline) >= 0) {
+    load->late++;
+  }
+}
+
+static void _backup(void * arg) {
+  SimLoad_t * load = arg;
+  sim_run(load->min / 4);
+  load->jobs++;
+}
+
+// Refine until the deadline cuts it off or 1 in 8 steps gets there
+static bool _optional(void * arg) {
+  UNUSED(arg);
+  sim_run(KERNEL_CYCLES_PER_TICK / 2);
+  return _random() % 8 == 0;
+}
+
+static void _coroutine(Pt_t * pt, void * arg) {
+  SimLoad_t * load = arg;
+
+  PT_BEGIN(pt);
+  while (1) {
+    sim_run(_sample(load));
+    load->jobs++;
+    PT_YIELD(pt);
+  }
+  PT_END(pt);
+}
+
+TASK_STACK(control_stack, 256);
+TASK_STACK(sensor_stack, 256);
+TASK_STACK(log_stack, 256);
+TASK_STACK(event_stack, 256);
+
+static SimLoad_t loads[] = {
+  { .id = 0, .min = 8000, .max = 14000 },
+  { .id = 1, .min = 40000, .max = 90000, .spike = 120000, .spike_odds = 10000 },
+  { .id = 2, .min = 200000, .max = 900000 },
+  { .id = 3, .min = 1000, .max = 3000 },
+  { .id = 4, .min = 10000, .max = 40000 },
+};
+
+const TaskConf_t task_table[] = {
+  {
+    .name       = "control",
+    .job        = _job,
+    .arg        = &loads[0],
+    .stack      = control_stack,
+    .stack_size = sizeof(control_stack),
+    .period     = 5,
+    .wcet       = 14400,
+    .policy     = DEADLINE_CONTINUE,
+  },
+  {
+    .name        = "sensor",
+    .job         = _job,
+    .arg         = &loads[1],
+    .stack       = sensor_stack,
+    .stack_size  = sizeof(sensor_stack),
+    .period      = 10,
+    .wcet        = 96000, // The spikes overrun it and run the backup
+    .policy      = DEADLINE_ABORT,
+    .backup      = _backup,
+    .backup_wcet = 20000,
+  },
+  {
+    .name       = "log",
+    .job        = _job,
+    .arg        = &loads[2],
+    .stack      = log_stack,
+    .stack_size = sizeof(log_stack),
+    .period     = 100,
+    .wcet       = 960000,
+    .policy     = DEADLINE_CONTINUE,
+    .optional   = _optional,
+  },
+  {
+    .name      = "blink",
+    .coroutine = _coroutine,
+    .arg       = &loads[3],
+    .period    = 50,
+    .wcet      = 4800,
+    .policy    = DEADLINE_CONTINUE,
+  },
+  {
+    .name       = "event",
+    .job        = _job,
+    .arg        = &loads[4],
+    .stack      = event_stack,
+    .stack_size = sizeof(event_stack),
+    .period     = 20,
+    .offset     = 3,
+    .wcet       = 48000,
+    .policy     = DEADLINE_ABORT,
+  },
+};
+const uint8_t task_count = ARRAY_SIZE(task_table);
+
+// The target spins, there's no point here
+void deadline_fault_handler(Task_t * task) {
+  printf("Hard deadline missed by %s at tick %u\n", task->conf->name, kernel_now());
+  exit(1);
+}
+
+/************************************
+ * MAIN
+ ************************************/
+
+int main(int argc, char ** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 3600;
+  rng            = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+  end            = (uint64_t) (seconds * KERNEL_CPU_HZ);
+  if (rng == 0) {
+    rng = 1;
+  }
+
+  if (!kernel_init()) {
+    printf("Task set failed admission control\n");
+    return 1;
+  }
+
+  struct timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (!_setjmp(finished)) {
+    kernel_start();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  double wall = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+  double sim  = (double) now / KERNEL_CPU_HZ;
+  printf("%s, %.0f s simulated in %.2f s (%.0fx), %u ticks, %u switches%s\n", KERNEL_SCHED == SCHED_EDF ? "EDF" : "RMS", sim, wall,
+         sim / wall, kernel_now(), kernel_switches(), kernel_harmonic() ? ", harmonic" : "");
+
+  printf("%-10s%12s%10s%10s%10s%10s%8s%14s%14s\n", "task", "jobs", "late", "misses", "overruns", "backups", "cpu %", "response us",
+         "jitter us");
+  for (uint8_t i = 0; i < task_count; i++) {
+    const Task_t * task = kernel_task(i);
+    const SimLoad_t * load = task_table[i].arg;
+    printf("%-10s%12llu%10llu%10u%10u%10u%8.2f", task_table[i].name, (unsigned long long) load->jobs,
+           (unsigned long long) load->late, task->deadline_stats.misses, task->overruns, task->backups,
+           100.0 * task->cpu_cycles / now);
+#if KERNEL_STATS
+    printf("%14.1f%14.1f", task->response.max * 1e6 / KERNEL_CPU_HZ, task->jitter.max * 1e6 / KERNEL_CPU_HZ);
+#endif
+    printf("\n");
+  }
+
+  // Only a spike takes a job past its WCET. Anything else is the kernel
+  // charging a job for time it didn't use.
+  bool ok = true;
+  for (uint8_t i = 0; i < task_count; i++) {
+    const SimLoad_t * load = task_table[i].arg;
+    if (kernel_task(i)->overruns > load->spikes) {
+      printf("%s overran %u times on %u spikes\n", task_table[i].name, kernel_task(i)->overruns, load->spikes);
+      ok = false;
+    }
+  }
+
+#if KERNEL_DVFS
+  printf("clock     ");
+  for (uint16_t div = 1; div < ARRAY_SIZE(div_cycles); div++) {
+    if (div_cycles[div]) {
+      printf("  /%u %.2f%%", div, 100.0 * div_cycles[div] / now);
+    }
+  }
+  printf(", %llu switches\n", (unsigned long long) clock_switches);
+#endif
+
+  if (argc > 3) {
+    FILE * profile = fopen(argv[3], "w");
+    if (!profile) {
+      perror(argv[3]);
+      return 1;
+    }
+    fprintf(profile, "# calls %.1f\n", sim);
+    fprintf(profile, "SysTick_Handler %llu\nkernel_tick %llu\n", (unsigned long long) ticks_taken,
+            (unsigned long long) ticks_taken);
+    fprintf(profile, "PendSV_Handler %llu\nkernel_switch %llu\n", (unsigned long long) switches_taken,
+            (unsigned long long) switches_taken);
+    fprintf(profile, "TC4_Handler %llu\nkernel_budget_expired %llu\n", (unsigned long long) budgets_taken,
+            (unsigned long long) budgets_taken);
+    fclose(profile);
+  }
+  return ok ? 0 : 1;
+}
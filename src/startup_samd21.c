@@ -33,6 +33,7 @@
 extern uint32_t _sfixed;
 extern uint32_t _efixed;
 extern uint32_t _etext;
+extern uint32_t _sirelocate;
 extern uint32_t _srelocate;
 extern uint32_t _erelocate;
 extern uint32_t _szero;
@@ -46,12 +47,14 @@ int main(void);
 
 void __libc_init_array(void);
 
+uint32_t boot_cycles;
+
 /* Default empty handler */
 void Dummy_Handler(void);
 
 /* Cortex-M0+ core handlers */
 void NonMaskableInt_Handler(void) __attribute__((weak, alias("Dummy_Handler")));
-void HardFault_Handler(void);
+void HardFault_Handler(void) __attribute__((weak));
 void SVCall_Handler(void) __attribute__((weak, alias("Dummy_Handler")));
 void PendSV_Handler(void) __attribute__((weak, alias("Dummy_Handler")));
 void SysTick_Handler(void) __attribute__((weak, alias("Dummy_Handler")));
@@ -209,27 +212,78 @@ const DeviceVectors exception_table
 #endif
     };
 
+/*
+ * Word copy and fill for Reset_Handler, four words per LDM/STM and then
+ * one at a time for the rest. 13 cycles per 16 bytes instead of around 28
+ * for a word at a time loop. bytes must be a multiple of 4.
+ */
+static inline __attribute__((always_inline)) void _copy_words(uint32_t * dest, const uint32_t * src, uint32_t bytes) {
+  __asm__ volatile(".syntax unified\n"
+                   "  subs  %[n], #16\n"
+                   "  blo   2f\n"
+                   "1:\n"
+                   "  ldmia %[s]!, {r3, r4, r5, r6}\n"
+                   "  stmia %[d]!, {r3, r4, r5, r6}\n"
+                   "  subs  %[n], #16\n"
+                   "  bhs   1b\n"
+                   "2:\n"
+                   "  adds  %[n], #16\n"
+                   "  beq   4f\n"
+                   "3:\n"
+                   "  ldmia %[s]!, {r3}\n"
+                   "  stmia %[d]!, {r3}\n"
+                   "  subs  %[n], #4\n"
+                   "  bne   3b\n"
+                   "4:\n"
+                   ".syntax divided"
+                   : [d] "+l"(dest), [s] "+l"(src), [n] "+l"(bytes)
+                   :
+                   : "r3", "r4", "r5", "r6", "cc", "memory");
+}
+
+static inline __attribute__((always_inline)) void _zero_words(uint32_t * dest, uint32_t bytes) {
+  __asm__ volatile(".syntax unified\n"
+                   "  movs  r3, #0\n"
+                   "  movs  r4, #0\n"
+                   "  movs  r5, #0\n"
+                   "  movs  r6, #0\n"
+                   "  subs  %[n], #16\n"
+                   "  blo   2f\n"
+                   "1:\n"
+                   "  stmia %[d]!, {r3, r4, r5, r6}\n"
+                   "  subs  %[n], #16\n"
+                   "  bhs   1b\n"
+                   "2:\n"
+                   "  adds  %[n], #16\n"
+                   "  beq   4f\n"
+                   "3:\n"
+                   "  stmia %[d]!, {r3}\n"
+                   "  subs  %[n], #4\n"
+                   "  bne   3b\n"
+                   "4:\n"
+                   ".syntax divided"
+                   : [d] "+l"(dest), [n] "+l"(bytes)
+                   :
+                   : "r3", "r4", "r5", "r6", "cc", "memory");
+}
+
 /**
  * \brief This is the code that gets called on processor reset.
  * To initialize the device, and call the main() routine.
  */
 void Reset_Handler(void) {
-  uint32_t *pSrc, *pDest;
+  /* Count cycles to main() on SysTick (CPU clock), for boot_cycles */
+  SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+  SysTick->VAL  = 0;
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
 
   /* Initialize the relocate segment */
-  pSrc  = &_etext;
-  pDest = &_srelocate;
-
-  if (pSrc != pDest) {
-    for (; pDest < &_erelocate;) {
-      *pDest++ = *pSrc++;
-    }
+  if (&_sirelocate != &_srelocate) {
+    _copy_words(&_srelocate, &_sirelocate, (uintptr_t) &_erelocate - (uintptr_t) &_srelocate);
   }
 
-  /* Clear the zero segment */
-  for (pDest = &_szero; pDest < &_ezero;) {
-    *pDest++ = 0;
-  }
+  /* Clear the zero segment. .noinit after it is left alone */
+  _zero_words(&_szero, (uintptr_t) &_ezero - (uintptr_t) &_szero);
 
   /* Set the vector table base address */
   // pSrc      = (uint32_t *) &_sfixed;
@@ -251,6 +305,10 @@ void Reset_Handler(void) {
   /* Initialize the C library */
   __libc_init_array();
 
+  /* Stop the count, port_start() sets SysTick up again for the tick */
+  boot_cycles   = SysTick_LOAD_RELOAD_Msk - SysTick->VAL;
+  SysTick->CTRL = 0;
+
   /* Branch to main function */
   main();
 
@@ -269,8 +327,9 @@ void Dummy_Handler(void) {
 /**
  * @brief Default interrupt handler for HardFaults.
  * Split off from Dummy_Handler so HardFaults are more obvious.
+ * Weak so the kernel can recover faults in tasks, see kernel/port.c.
  */
-void HardFault_Handler(void) {
+__attribute__((weak)) void HardFault_Handler(void) {
   while (1) {
   }
 }
\ No newline at end of file